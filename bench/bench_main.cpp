@@ -0,0 +1,320 @@
+#include "json.h"
+#include "map_builder.h"
+#include "network_generator.h"
+#include "transport_data.h"
+#include "transport_database.h"
+#include "transport_informer.h"
+#include "transport_router.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Every allocation of the process is counted, so a benchmark reports the allocations of its operations
+namespace {
+  atomic<uint64_t> allocation_count{0};
+  atomic<uint64_t> allocated_bytes{0};
+}
+
+void *operator new(size_t size) {
+  allocation_count.fetch_add(1, memory_order_relaxed);
+  allocated_bytes.fetch_add(size, memory_order_relaxed);
+  if (void *memory = malloc(size == 0 ? 1 : size)) {
+    return memory;
+  }
+  throw bad_alloc();
+}
+
+void operator delete(void *memory) noexcept {
+  free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+  free(memory);
+}
+
+namespace {
+  struct Options {
+    NetworkGenerator::Params network;
+    size_t repeat = 3;
+    size_t route_queries = 10000;
+    size_t thread_count = 1;
+    string filter;
+  };
+
+  Options ParseOptions(int argc, const char **argv) {
+    Options options;
+    for (int arg_idx = 1; arg_idx < argc; ++arg_idx) {
+      const string_view name = argv[arg_idx];
+      if (name == "--help") {
+        cout << "Usage: transport_catalog_bench\n" << NetworkGenerator::PARAMS_USAGE
+             << "    [--repeat N] [--route-queries N] [--threads N] [--filter SUBSTRING]\n";
+        exit(0);
+      }
+      if (arg_idx + 1 == argc) {
+        throw invalid_argument("no value for " + string(name));
+      }
+      const string value = argv[++arg_idx];
+      if (NetworkGenerator::ParseParam(name, value, options.network)) {
+        continue;
+      } else if (name == "--repeat") {
+        options.repeat = max<size_t>(stoul(value), 1);
+      } else if (name == "--route-queries") {
+        options.route_queries = stoul(value);
+      } else if (name == "--threads") {
+        options.thread_count = max<size_t>(stoul(value), 1);
+      } else if (name == "--filter") {
+        options.filter = value;
+      } else {
+        throw invalid_argument("unknown option " + string(name));
+      }
+    }
+    if (options.network.stop_count == 0) {
+      throw invalid_argument("there must be stops");
+    }
+    return options;
+  }
+
+  const size_t REPEATED_ROUTE_COUNT = 300;
+
+  long GetPeakRssKb() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+  }
+
+  // Discards whatever is written, for measuring serialization alone
+  class NullBuffer : public streambuf {
+   protected:
+    int overflow(int c) override { return c; }
+    streamsize xsputn(const char *, streamsize count) override { return count; }
+  };
+
+  // Ignores parsing events, for measuring the parser alone
+  class NullHandler : public Json::Handler {
+   public:
+    void StartArray() override {}
+    void EndArray() override {}
+    void StartDict() override {}
+    void EndDict() override {}
+    void Key(string_view) override {}
+    void String(string_view) override {}
+    void Int(int) override {}
+    void Double(double) override {}
+    void Bool(bool) override {}
+  };
+
+  // Prints a JSON object per benchmark: time, allocations and bytes allocated per operation,
+  // and the peak resident set size of the process so far
+  class Reporter {
+   public:
+    explicit Reporter(string filter) : filter_(move(filter)) {}
+
+    bool IsEnabled(string_view name) const {
+      return name.find(filter_) != string_view::npos;
+    }
+
+    // Runs operation iterations times; setup runs before every iteration and is not measured.
+    // For operations processing several items the time per item is added.
+    void Measure(const string &name, size_t iterations, const function<void()> &operation,
+                 const function<void()> &setup = {}, size_t items_per_op = 1) {
+      if (!IsEnabled(name))
+        return;
+      chrono::nanoseconds elapsed{0};
+      uint64_t allocations = 0;
+      uint64_t bytes = 0;
+      for (size_t iteration = 0; iteration < iterations; ++iteration) {
+        if (setup)
+          setup();
+        const uint64_t allocations_before = allocation_count.load();
+        const uint64_t bytes_before = allocated_bytes.load();
+        const auto start = chrono::steady_clock::now();
+        operation();
+        elapsed += chrono::steady_clock::now() - start;
+        allocations += allocation_count.load() - allocations_before;
+        bytes += allocated_bytes.load() - bytes_before;
+      }
+      vector<pair<string, double>> extra;
+      if (items_per_op > 1)
+        extra.emplace_back("ns_per_item", static_cast<double>(elapsed.count()) / iterations / items_per_op);
+      Report(name, iterations, static_cast<double>(elapsed.count()), allocations, bytes, extra);
+    }
+
+    // Measures every call on its own and adds percentiles of their times
+    void MeasureLatency(const string &name, size_t calls, const function<void(size_t)> &operation) {
+      if (!IsEnabled(name) || calls == 0)
+        return;
+      vector<double> latencies;
+      latencies.reserve(calls);
+      const uint64_t allocations_before = allocation_count.load();
+      const uint64_t bytes_before = allocated_bytes.load();
+      for (size_t call = 0; call < calls; ++call) {
+        const auto start = chrono::steady_clock::now();
+        operation(call);
+        latencies.push_back(static_cast<double>((chrono::steady_clock::now() - start).count()));
+      }
+      const uint64_t allocations = allocation_count.load() - allocations_before;
+      const uint64_t bytes = allocated_bytes.load() - bytes_before;
+      double total = 0;
+      for (const double latency : latencies) {
+        total += latency;
+      }
+      sort(latencies.begin(), latencies.end());
+      const auto percentile = [&latencies](double share) {
+        return latencies[min(latencies.size() - 1, static_cast<size_t>(share * latencies.size()))];
+      };
+      Report(name, calls, total, allocations, bytes, {
+          {"p50_ns", percentile(0.5)},
+          {"p90_ns", percentile(0.9)},
+          {"p99_ns", percentile(0.99)},
+          {"max_ns", latencies.back()},
+      });
+    }
+
+   private:
+    void Report(const string &name, size_t iterations, double total_ns, uint64_t allocations, uint64_t bytes,
+                const vector<pair<string, double>> &extra) {
+      Json::Writer writer(cout);
+      writer.StartDict();
+      writer.Key("name");
+      writer.String(name);
+      writer.Key("iterations");
+      writer.Int(static_cast<int>(iterations));
+      writer.Key("ns_per_op");
+      writer.Double(total_ns / iterations);
+      writer.Key("allocs_per_op");
+      writer.Double(static_cast<double>(allocations) / iterations);
+      writer.Key("bytes_per_op");
+      writer.Double(static_cast<double>(bytes) / iterations);
+      for (const auto &[key, value] : extra) {
+        writer.Key(key);
+        writer.Double(value);
+      }
+      writer.Key("peak_rss_kb");
+      writer.Int(static_cast<int>(GetPeakRssKb()));
+      writer.EndDict();
+      writer.Flush();
+      cout << endl;
+    }
+
+    string filter_;
+  };
+
+  void RunBenchmarks(const Options &options) {
+    Reporter reporter(options.filter);
+    const Json::Dict input = NetworkGenerator::GenerateInput(options.network);
+    const Json::Array &base_requests = input.at("base_requests").AsArray();
+    const Json::Array &stat_requests = input.at("stat_requests").AsArray();
+    const Json::Dict &routing_settings = input.at("routing_settings").AsMap();
+    const Json::Dict &render_settings = input.at("render_settings").AsMap();
+
+    ostringstream input_stream;
+    {
+      Json::Writer writer(input_stream);
+      Json::WriteNode(Json::Node(input), writer);
+    }
+    const string input_text = input_stream.str();
+    // per byte of the input
+    reporter.Measure("json_parse", options.repeat, [&input_text] {
+      NullHandler handler;
+      Json::Parse(input_text, handler);
+    }, {}, input_text.size());
+    reporter.Measure("json_load", options.repeat, [&input_text] {
+      Json::Load(input_text);
+    }, {}, input_text.size());
+    // base and stat requests read right from parsing events, as the catalog does
+    reporter.Measure("input_read", options.repeat, [&input_text] {
+      TransportData::DataBuilder data_builder;
+      Requests::StatRequestsBuilder stat_requests_builder;
+      Json::Load(input_text, {{"base_requests", &data_builder}, {"stat_requests", &stat_requests_builder}});
+      [[maybe_unused]] const auto stat_requests = move(stat_requests_builder).Build();
+    }, {}, input_text.size());
+
+    reporter.Measure("read_data", options.repeat, [&base_requests] {
+      TransportData::ReadData(base_requests);
+    });
+
+    const TransportData::Data data = TransportData::ReadData(base_requests);
+    optional<TransportData::Data> data_copy;
+    const auto copy_data = [&data, &data_copy] { data_copy = data; };
+    // the router may be built in the background, a route request waits for it
+    reporter.Measure("database_build", options.repeat, [&] {
+      TransportDatabase::Database db(move(*data_copy), routing_settings, options.thread_count);
+      [[maybe_unused]] const auto route = db.FindRoute(string(data.stop_names[0]), string(data.stop_names[0]));
+    }, copy_data);
+
+    reporter.Measure("router_build", options.repeat, [&] {
+      TransportRouter router(data, routing_settings, options.thread_count);
+    });
+
+    // contraction hierarchies preprocessing whatever --algorithm is, per stop too: it grows fastest with the network
+    for (const string graph_model : {"stop_pairs", "bus_chains"}) {
+      Json::Dict ch_settings = routing_settings;
+      ch_settings["routing_algorithm"] = Json::Node("contraction_hierarchies"s);
+      ch_settings["graph_model"] = Json::Node(graph_model);
+      reporter.Measure("ch_build_" + graph_model, options.repeat, [&] {
+        TransportRouter router(data, ch_settings, options.thread_count);
+      }, {}, data.stops.size());
+    }
+
+    const TransportDatabase::Database db(data, routing_settings, options.thread_count);
+    mt19937_64 generator(options.network.seed);
+    uniform_int_distribution<size_t> random_stop(0, db.GetStopCount() - 1);
+    vector<pair<string, string>> route_queries;
+    route_queries.reserve(options.route_queries);
+    for (size_t query_idx = 0; query_idx < options.route_queries; ++query_idx) {
+      route_queries.emplace_back(db.GetStopName(random_stop(generator)), db.GetStopName(random_stop(generator)));
+    }
+    reporter.MeasureLatency("route_latency", route_queries.size(), [&db, &route_queries](size_t query_idx) {
+      [[maybe_unused]] const auto route = db.FindRoute(route_queries[query_idx].first, route_queries[query_idx].second);
+    });
+
+    // skewed traffic: a few hundred pairs repeated, mostly answered by the route cache
+    const TransportDatabase::Database cached_db(data, routing_settings, options.thread_count);
+    uniform_int_distribution<size_t> random_query(0, min<size_t>(route_queries.size(), REPEATED_ROUTE_COUNT) - 1);
+    reporter.MeasureLatency("route_repeated_latency", route_queries.size(), [&](size_t) {
+      const auto &[stop_from, stop_to] = route_queries[random_query(generator)];
+      [[maybe_unused]] const auto route = cached_db.FindRoute(stop_from, stop_to);
+    });
+
+    reporter.Measure("map_render", options.repeat, [&db, &render_settings] {
+      Visualisation::MapBuilder map_builder(db, render_settings);
+      [[maybe_unused]] const string &map = map_builder.GetMap();
+    });
+
+    const auto map_builder = make_shared<Visualisation::MapBuilder>(db, render_settings);
+    map_builder->Render();
+    const TransportInformer::Informer informer(map_builder, options.thread_count);
+    NullBuffer null_buffer;
+    ostream null_stream(&null_buffer);
+    reporter.Measure("informer_requests", options.repeat, [&] {
+      Json::Writer writer(null_stream, 6);
+      informer.ProcessRequests(db, stat_requests, writer);
+    }, {}, stat_requests.size());
+  }
+}
+
+// Benchmarks of the stages of the pipeline on a synthetic network, one JSON object per line
+int main(int argc, const char **argv) {
+  try {
+    RunBenchmarks(ParseOptions(argc, argv));
+  } catch (const exception &error) {
+    cerr << error.what() << endl;
+    return 1;
+  }
+  return 0;
+}
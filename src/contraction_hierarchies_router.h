@@ -0,0 +1,498 @@
+#pragma once
+
+#include "router.h"
+#include "search_space.h"
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  // Contracts vertices one by one in the order of their importance and adds shortcut edges
+  // preserving shortest paths among the remaining ones. Queries then run a bidirectional Dijkstra
+  // which only follows edges leading to more important vertices, so they settle a few hundred
+  // vertices even on large graphs. Shortcuts are unpacked back to the original edges.
+  template <typename Weight>
+  class ContractionHierarchiesRouter : public Router<Weight> {
+  private:
+    using typename Router<Weight>::Graph;
+    using typename Router<Weight>::ExpandedRoute;
+
+  public:
+    explicit ContractionHierarchiesRouter(const Graph& graph);
+    ContractionHierarchiesRouter(const Graph& graph, std::istream& input);
+
+    std::optional<Weight> BuildRoute(VertexId from, VertexId to, ExpandedRoute& edges) const override;
+    void Serialize(std::ostream& output) const override;
+
+  private:
+    using HierarchyEdgeId = size_t;
+
+    struct HierarchyEdge {
+      VertexId from;
+      VertexId to;
+      Weight weight;
+      std::optional<EdgeId> original_edge;
+      // halves of a shortcut: from -> contracted vertex -> to
+      HierarchyEdgeId first_half = 0;
+      HierarchyEdgeId second_half = 0;
+    };
+
+    struct VertexInternalData {
+      Weight weight;
+      std::optional<HierarchyEdgeId> prev_edge;
+    };
+
+    struct WitnessData {
+      Weight weight;
+      size_t hop_count;
+    };
+
+    using SearchSpace = ::Graph::SearchSpace<VertexInternalData>;
+    using WitnessSpace = ::Graph::SearchSpace<WitnessData>;
+    using Queue = SearchQueue<Weight>;
+
+    // Witness searches give up after settling this many vertices or going this many edges away
+    // from the source and keep the shortcut
+    static constexpr size_t WITNESS_SETTLED_LIMIT = 500;
+    static constexpr size_t WITNESS_HOP_LIMIT = 3;
+
+    void InitializeHierarchyEdges(const Graph& graph);
+    void ContractVertices();
+    // adds the shortcuts the last ComputePriority call found for the vertex
+    void ContractVertex(VertexId vertex);
+    int ComputePriority(VertexId vertex);
+    // leaves the shortcuts needed to contract the vertex in shortcuts_
+    void FindShortcuts(VertexId vertex);
+    void RunWitnessSearch(VertexId source, VertexId excluded_vertex, Weight max_weight, size_t target_count);
+    bool HasIncomingEdgeAvoiding(VertexId vertex, VertexId excluded_vertex) const;
+    HierarchyEdgeId AddHierarchyEdge(HierarchyEdge edge);
+    void BuildSearchGraphs();
+
+    void ExpandSearchSpace(Queue& queue, SearchSpace& search_space,
+                           const FlatLists<HierarchyEdgeId>& search_graph, bool forward) const;
+    void UnpackEdge(HierarchyEdgeId edge_id, std::vector<HierarchyEdgeId>& stack, ExpandedRoute& edges) const;
+
+    // the hierarchy is kept in flat arrays, which a deserialized router may view in a mapped snapshot
+    FlatArray<HierarchyEdge> hierarchy_edges_;
+    // edges to vertices of higher rank, by source vertex
+    FlatLists<HierarchyEdgeId> upward_edges_;
+    // edges from vertices of higher rank, by target vertex
+    FlatLists<HierarchyEdgeId> downward_edges_;
+
+    // preprocessing state
+    std::vector<HierarchyEdge> edges_;
+    std::vector<size_t> ranks_;
+    std::vector<std::vector<HierarchyEdgeId>> outgoing_edges_;
+    std::vector<std::vector<HierarchyEdgeId>> incoming_edges_;
+    std::vector<int> contracted_neighbours_;
+    std::vector<int> levels_;
+    std::vector<HierarchyEdge> shortcuts_;
+    // targets of the edges out of the vertex which witness searches look for
+    std::vector<bool> is_witness_target_;
+    WitnessSpace witness_space_;
+    Queue witness_queue_;
+
+    // Search spaces and buffers are reused by queries; concurrent queries take different ones from the pool
+    struct QuerySpaces {
+      explicit QuerySpaces(size_t vertex_count) : forward(vertex_count), backward(vertex_count) {}
+      void Reset() {
+        forward.Reset();
+        backward.Reset();
+        forward_queue.clear();
+        backward_queue.clear();
+        path.clear();
+      }
+
+      SearchSpace forward;
+      SearchSpace backward;
+      Queue forward_queue;
+      Queue backward_queue;
+      std::vector<HierarchyEdgeId> path;
+      std::vector<HierarchyEdgeId> unpack_stack;
+    };
+
+    size_t vertex_count_;
+    mutable QuerySpacesPool<QuerySpaces> query_spaces_pool_;
+  };
+
+
+  template <typename Weight>
+  ContractionHierarchiesRouter<Weight>::ContractionHierarchiesRouter(const Graph& graph)
+      : Router<Weight>(graph),
+        ranks_(graph.GetVertexCount()),
+        outgoing_edges_(graph.GetVertexCount()),
+        incoming_edges_(graph.GetVertexCount()),
+        contracted_neighbours_(graph.GetVertexCount(), 0),
+        levels_(graph.GetVertexCount(), 0),
+        is_witness_target_(graph.GetVertexCount(), false),
+        witness_space_(graph.GetVertexCount()),
+        vertex_count_(graph.GetVertexCount())
+  {
+    InitializeHierarchyEdges(graph);
+    ContractVertices();
+    BuildSearchGraphs();
+
+    edges_ = {};
+    ranks_ = {};
+    outgoing_edges_ = {};
+    incoming_edges_ = {};
+    contracted_neighbours_ = {};
+    levels_ = {};
+    shortcuts_ = {};
+    is_witness_target_ = {};
+    witness_space_ = WitnessSpace{};
+    witness_queue_ = Queue{};
+  }
+
+  template <typename Weight>
+  ContractionHierarchiesRouter<Weight>::ContractionHierarchiesRouter(const Graph& graph, std::istream& input)
+      : Router<Weight>(graph),
+        vertex_count_(graph.GetVertexCount())
+  {
+    Serialization::Read(input, hierarchy_edges_);
+    Serialization::Read(input, upward_edges_);
+    Serialization::Read(input, downward_edges_);
+  }
+
+  template <typename Weight>
+  void ContractionHierarchiesRouter<Weight>::Serialize(std::ostream& output) const {
+    Serialization::Write(output, hierarchy_edges_);
+    Serialization::Write(output, upward_edges_);
+    Serialization::Write(output, downward_edges_);
+  }
+
+  template <typename Weight>
+  void ContractionHierarchiesRouter<Weight>::InitializeHierarchyEdges(const Graph& graph) {
+    const size_t vertex_count = graph.GetVertexCount();
+    std::unordered_map<VertexId, HierarchyEdgeId> lightest_edges;
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      lightest_edges.clear();
+      for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
+        const auto edge = graph.GetEdge(edge_id);
+        assert(edge.weight >= 0);
+        if (edge.to == vertex) {
+          continue;  // loops never shorten a route
+        }
+        if (auto it = lightest_edges.find(edge.to); it != lightest_edges.end()) {
+          auto& lightest_edge = edges_[it->second];
+          if (edge.weight < lightest_edge.weight) {
+            lightest_edge.weight = edge.weight;
+            lightest_edge.original_edge = edge_id;
+          }
+        } else {
+          lightest_edges[edge.to] = AddHierarchyEdge({edge.from, edge.to, edge.weight, edge_id});
+        }
+      }
+    }
+  }
+
+  template <typename Weight>
+  typename ContractionHierarchiesRouter<Weight>::HierarchyEdgeId
+  ContractionHierarchiesRouter<Weight>::AddHierarchyEdge(HierarchyEdge edge) {
+    const HierarchyEdgeId id = edges_.size();
+    outgoing_edges_[edge.from].push_back(id);
+    incoming_edges_[edge.to].push_back(id);
+    edges_.push_back(std::move(edge));
+    return id;
+  }
+
+  template <typename Weight>
+  void ContractionHierarchiesRouter<Weight>::ContractVertices() {
+    const size_t vertex_count = ranks_.size();
+    std::priority_queue<std::pair<int, VertexId>, std::vector<std::pair<int, VertexId>>, std::greater<>> queue;
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      queue.push({ComputePriority(vertex), vertex});
+    }
+
+    size_t rank = 0;
+    while (!queue.empty()) {
+      const VertexId vertex = queue.top().second;
+      queue.pop();
+      // lazy update: priorities of the remaining vertices change as their neighbours get contracted.
+      // The shortcuts found for the new priority are the ones the vertex gets contracted with.
+      const int priority = ComputePriority(vertex);
+      if (!queue.empty() && priority > queue.top().first) {
+        queue.push({priority, vertex});
+        continue;
+      }
+      ContractVertex(vertex);
+      ranks_[vertex] = rank++;
+    }
+  }
+
+  // Prefers vertices which add few shortcuts, and spreads contraction evenly over the graph
+  // by penalizing vertices with many contracted neighbours or a deep hierarchy below them
+  template <typename Weight>
+  int ContractionHierarchiesRouter<Weight>::ComputePriority(VertexId vertex) {
+    const int removed_edge_count = static_cast<int>(incoming_edges_[vertex].size() + outgoing_edges_[vertex].size());
+    FindShortcuts(vertex);
+    const int edge_difference = static_cast<int>(shortcuts_.size()) - removed_edge_count;
+    return 2 * edge_difference + contracted_neighbours_[vertex] + levels_[vertex];
+  }
+
+  template <typename Weight>
+  void ContractionHierarchiesRouter<Weight>::FindShortcuts(VertexId vertex) {
+    shortcuts_.clear();
+    const auto& outgoing_edges = outgoing_edges_[vertex];
+    if (outgoing_edges.empty()) {
+      return;
+    }
+    // targets which only the vertex leads to can't have witnesses, so searches don't wait for them
+    Weight max_outgoing_weight = 0;
+    size_t target_count = 0;
+    for (const HierarchyEdgeId edge_id : outgoing_edges) {
+      const HierarchyEdge& edge = edges_[edge_id];
+      if (is_witness_target_[edge.to] || !HasIncomingEdgeAvoiding(edge.to, vertex)) {
+        continue;
+      }
+      is_witness_target_[edge.to] = true;
+      ++target_count;
+      max_outgoing_weight = std::max(max_outgoing_weight, edge.weight);
+    }
+
+    for (const HierarchyEdgeId incoming_edge_id : incoming_edges_[vertex]) {
+      const HierarchyEdge& incoming_edge = edges_[incoming_edge_id];
+      if (target_count == 0) {
+        witness_space_.Reset();
+      } else {
+        RunWitnessSearch(incoming_edge.from, vertex, incoming_edge.weight + max_outgoing_weight, target_count);
+      }
+      for (const HierarchyEdgeId outgoing_edge_id : outgoing_edges) {
+        const HierarchyEdge& outgoing_edge = edges_[outgoing_edge_id];
+        if (outgoing_edge.to == incoming_edge.from) {
+          continue;
+        }
+        const Weight shortcut_weight = incoming_edge.weight + outgoing_edge.weight;
+        const auto& witness = witness_space_[outgoing_edge.to];
+        if (!witness || shortcut_weight < witness->weight) {
+          shortcuts_.push_back({
+              incoming_edge.from,
+              outgoing_edge.to,
+              shortcut_weight,
+              std::nullopt,
+              incoming_edge_id,
+              outgoing_edge_id
+          });
+        }
+      }
+    }
+    for (const HierarchyEdgeId edge_id : outgoing_edges) {
+      is_witness_target_[edges_[edge_id].to] = false;
+    }
+  }
+
+  template <typename Weight>
+  bool ContractionHierarchiesRouter<Weight>::HasIncomingEdgeAvoiding(VertexId vertex, VertexId excluded_vertex) const {
+    const auto& incoming_edges = incoming_edges_[vertex];
+    return std::any_of(incoming_edges.begin(), incoming_edges.end(), [this, excluded_vertex](HierarchyEdgeId edge_id) {
+      return edges_[edge_id].from != excluded_vertex;
+    });
+  }
+
+  template <typename Weight>
+  void ContractionHierarchiesRouter<Weight>::ContractVertex(VertexId vertex) {
+    for (const HierarchyEdge& shortcut : shortcuts_) {
+      AddHierarchyEdge(shortcut);
+    }
+
+    // edges of the remaining vertices lead only to each other, so searches don't scan contracted ones
+    auto detach_edge = [](std::vector<HierarchyEdgeId>& edge_ids, HierarchyEdgeId edge_id) {
+      auto it = std::find(edge_ids.begin(), edge_ids.end(), edge_id);
+      *it = edge_ids.back();
+      edge_ids.pop_back();
+    };
+    auto update_neighbour = [this, vertex](VertexId neighbour) {
+      ++contracted_neighbours_[neighbour];
+      levels_[neighbour] = std::max(levels_[neighbour], levels_[vertex] + 1);
+    };
+    for (const HierarchyEdgeId edge_id : incoming_edges_[vertex]) {
+      const VertexId neighbour = edges_[edge_id].from;
+      detach_edge(outgoing_edges_[neighbour], edge_id);
+      update_neighbour(neighbour);
+    }
+    for (const HierarchyEdgeId edge_id : outgoing_edges_[vertex]) {
+      const VertexId neighbour = edges_[edge_id].to;
+      detach_edge(incoming_edges_[neighbour], edge_id);
+      update_neighbour(neighbour);
+    }
+  }
+
+  // Bounded Dijkstra among the remaining vertices; leaves the found weights in witness_space_.
+  // It stops once all the targets are settled. Vertices it does not reach are treated as having
+  // no witness, which only costs an extra shortcut.
+  template <typename Weight>
+  void ContractionHierarchiesRouter<Weight>::RunWitnessSearch(VertexId source, VertexId excluded_vertex,
+                                                              Weight max_weight, size_t target_count) {
+    witness_space_.Reset();
+    witness_queue_.clear();
+    witness_space_.Update(source, {0, 0});
+    witness_queue_.push({0, source});
+    size_t settled_count = 0;
+    size_t unsettled_target_count = target_count;
+    while (!witness_queue_.empty() && settled_count < WITNESS_SETTLED_LIMIT && unsettled_target_count > 0) {
+      const auto [weight, vertex] = witness_queue_.top();
+      witness_queue_.pop();
+      if (max_weight < weight) {
+        break;
+      }
+      const WitnessData vertex_data = *witness_space_[vertex];
+      if (vertex_data.weight < weight) {
+        continue;
+      }
+      ++settled_count;
+      unsettled_target_count -= is_witness_target_[vertex];
+      if (vertex_data.hop_count == WITNESS_HOP_LIMIT) {
+        continue;
+      }
+      for (const HierarchyEdgeId edge_id : outgoing_edges_[vertex]) {
+        const HierarchyEdge& edge = edges_[edge_id];
+        if (edge.to == excluded_vertex) {
+          continue;
+        }
+        const Weight candidate_weight = weight + edge.weight;
+        const auto& witness = witness_space_[edge.to];
+        if (!witness || candidate_weight < witness->weight) {
+          witness_space_.Update(edge.to, {candidate_weight, vertex_data.hop_count + 1});
+          witness_queue_.push({candidate_weight, edge.to});
+        }
+      }
+    }
+  }
+
+  template <typename Weight>
+  void ContractionHierarchiesRouter<Weight>::BuildSearchGraphs() {
+    std::vector<std::vector<HierarchyEdgeId>> upward_edges(ranks_.size());
+    std::vector<std::vector<HierarchyEdgeId>> downward_edges(ranks_.size());
+    for (HierarchyEdgeId edge_id = 0; edge_id < edges_.size(); ++edge_id) {
+      const HierarchyEdge& edge = edges_[edge_id];
+      if (ranks_[edge.from] < ranks_[edge.to]) {
+        upward_edges[edge.from].push_back(edge_id);
+      } else {
+        downward_edges[edge.to].push_back(edge_id);
+      }
+    }
+    hierarchy_edges_ = std::move(edges_);
+    upward_edges_ = FlatLists<HierarchyEdgeId>::Build(upward_edges);
+    downward_edges_ = FlatLists<HierarchyEdgeId>::Build(downward_edges);
+  }
+
+  template <typename Weight>
+  void ContractionHierarchiesRouter<Weight>::ExpandSearchSpace(
+      Queue& queue, SearchSpace& search_space,
+      const FlatLists<HierarchyEdgeId>& search_graph, bool forward) const {
+    const auto [weight, vertex] = queue.top();
+    queue.pop();
+    if (search_space[vertex]->weight < weight) {
+      return;  // stale queue item
+    }
+    for (const HierarchyEdgeId edge_id : search_graph[vertex]) {
+      const HierarchyEdge& edge = hierarchy_edges_[edge_id];
+      const VertexId next_vertex = forward ? edge.to : edge.from;
+      const Weight candidate_weight = weight + edge.weight;
+      const auto& next_vertex_data = search_space[next_vertex];
+      if (!next_vertex_data || candidate_weight < next_vertex_data->weight) {
+        search_space.Update(next_vertex, {candidate_weight, edge_id});
+        queue.push({candidate_weight, next_vertex});
+      }
+    }
+  }
+
+  template <typename Weight>
+  std::optional<Weight> ContractionHierarchiesRouter<Weight>::BuildRoute(VertexId from, VertexId to,
+                                                                         ExpandedRoute& edges) const {
+    edges.clear();
+    auto query_spaces = query_spaces_pool_.Acquire(vertex_count_);
+    SearchSpace& forward_space = query_spaces->forward;
+    SearchSpace& backward_space = query_spaces->backward;
+    forward_space.Update(from, {0, std::nullopt});
+    backward_space.Update(to, {0, std::nullopt});
+    Queue& forward_queue = query_spaces->forward_queue;
+    Queue& backward_queue = query_spaces->backward_queue;
+    forward_queue.push({0, from});
+    backward_queue.push({0, to});
+
+    // Both searches only go up, so they may not stop at the first meeting vertex: the best one is known
+    // only when each queue holds nothing lighter than the best route found so far.
+    std::optional<Weight> best_weight;
+    VertexId meeting_vertex = from;
+    auto update_best_route = [&](VertexId vertex) {
+      const auto& forward_data = forward_space[vertex];
+      const auto& backward_data = backward_space[vertex];
+      if (!forward_data || !backward_data) {
+        return;
+      }
+      const Weight weight = forward_data->weight + backward_data->weight;
+      if (!best_weight || weight < *best_weight) {
+        best_weight = weight;
+        meeting_vertex = vertex;
+      }
+    };
+    auto is_search_finished = [&best_weight](const Queue& queue) {
+      return queue.empty() || (best_weight && !(queue.top().first < *best_weight));
+    };
+
+    update_best_route(from);
+    while (!is_search_finished(forward_queue) || !is_search_finished(backward_queue)) {
+      if (!is_search_finished(forward_queue)) {
+        const VertexId vertex = forward_queue.top().second;
+        ExpandSearchSpace(forward_queue, forward_space, upward_edges_, true);
+        update_best_route(vertex);
+      }
+      if (!is_search_finished(backward_queue)) {
+        const VertexId vertex = backward_queue.top().second;
+        ExpandSearchSpace(backward_queue, backward_space, downward_edges_, false);
+        update_best_route(vertex);
+      }
+    }
+
+    if (!best_weight) {
+      query_spaces_pool_.Release(std::move(query_spaces));
+      return std::nullopt;
+    }
+
+    auto& forward_path = query_spaces->path;
+    for (auto edge_id = forward_space[meeting_vertex]->prev_edge;
+         edge_id;
+         edge_id = forward_space[hierarchy_edges_[*edge_id].from]->prev_edge) {
+      forward_path.push_back(*edge_id);
+    }
+    auto& unpack_stack = query_spaces->unpack_stack;
+    std::for_each(forward_path.rbegin(), forward_path.rend(), [&](HierarchyEdgeId edge_id) {
+      UnpackEdge(edge_id, unpack_stack, edges);
+    });
+    for (auto edge_id = backward_space[meeting_vertex]->prev_edge;
+         edge_id;
+         edge_id = backward_space[hierarchy_edges_[*edge_id].to]->prev_edge) {
+      UnpackEdge(*edge_id, unpack_stack, edges);
+    }
+    query_spaces_pool_.Release(std::move(query_spaces));
+
+    return best_weight;
+  }
+
+  template <typename Weight>
+  void ContractionHierarchiesRouter<Weight>::UnpackEdge(HierarchyEdgeId edge_id, std::vector<HierarchyEdgeId>& stack,
+                                                        ExpandedRoute& edges) const {
+    stack.push_back(edge_id);
+    while (!stack.empty()) {
+      const HierarchyEdge& edge = hierarchy_edges_[stack.back()];
+      stack.pop_back();
+      if (edge.original_edge) {
+        edges.push_back(*edge.original_edge);
+      } else {
+        stack.push_back(edge.second_half);
+        stack.push_back(edge.first_half);
+      }
+    }
+  }
+
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "router.h"
+#include "search_space.h"
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  // No preprocessing, memory proportional to the graph: every query runs Dijkstra from scratch.
+  // Search spaces are reused by queries and reset in time proportional to the vertices they reached.
+  template <typename Weight>
+  class DijkstraRouter : public Router<Weight> {
+  private:
+    using typename Router<Weight>::Graph;
+    using typename Router<Weight>::ExpandedRoute;
+
+  public:
+    explicit DijkstraRouter(const Graph& graph) : Router<Weight>(graph) {}
+    DijkstraRouter(const Graph& graph, std::istream&) : Router<Weight>(graph) {}
+
+    std::optional<Weight> BuildRoute(VertexId from, VertexId to, ExpandedRoute& edges) const override;
+    void Serialize(std::ostream&) const override {}
+
+  private:
+    struct VertexInternalData {
+      Weight weight;
+      std::optional<EdgeId> prev_edge;
+    };
+
+    struct QuerySpaces {
+      explicit QuerySpaces(size_t vertex_count) : vertices_data(vertex_count) {}
+      void Reset() {
+        vertices_data.Reset();
+        queue.clear();
+      }
+
+      SearchSpace<VertexInternalData> vertices_data;
+      SearchQueue<Weight> queue;
+    };
+
+    mutable QuerySpacesPool<QuerySpaces> query_spaces_pool_;
+  };
+
+
+  template <typename Weight>
+  std::optional<Weight> DijkstraRouter<Weight>::BuildRoute(VertexId from, VertexId to, ExpandedRoute& edges) const {
+    edges.clear();
+    const Graph& graph = this->graph_;
+    auto query_spaces = query_spaces_pool_.Acquire(graph.GetVertexCount());
+    auto& vertices_data = query_spaces->vertices_data;
+    auto& queue = query_spaces->queue;
+
+    vertices_data.Update(from, {0, std::nullopt});
+    queue.push({0, from});
+    while (!queue.empty()) {
+      const auto [weight, vertex] = queue.top();
+      queue.pop();
+      if (vertex == to) {
+        break;
+      }
+      if (vertices_data[vertex]->weight < weight) {
+        continue;  // stale queue item
+      }
+      for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
+        const Weight edge_weight = graph.GetEdgeWeight(edge_id);
+        assert(edge_weight >= 0);
+        const Weight candidate_weight = weight + edge_weight;
+        const VertexId next_vertex = graph.GetEdgeTarget(edge_id);
+        const auto& vertex_data = vertices_data[next_vertex];
+        if (!vertex_data || candidate_weight < vertex_data->weight) {
+          vertices_data.Update(next_vertex, {candidate_weight, edge_id});
+          queue.push({candidate_weight, next_vertex});
+        }
+      }
+    }
+
+    if (!vertices_data[to]) {
+      query_spaces_pool_.Release(std::move(query_spaces));
+      return std::nullopt;
+    }
+    for (std::optional<EdgeId> edge_id = vertices_data[to]->prev_edge;
+         edge_id;
+         edge_id = vertices_data[graph.GetEdge(*edge_id).from]->prev_edge) {
+      edges.push_back(*edge_id);
+    }
+    std::reverse(std::begin(edges), std::end(edges));
+
+    const Weight weight = vertices_data[to]->weight;
+    query_spaces_pool_.Release(std::move(query_spaces));
+    return weight;
+  }
+
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "utils.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Read-only contiguous array which either owns its items or views memory owned elsewhere,
+// e.g. a memory-mapped database snapshot; a view keeps its owner alive.
+template <typename T>
+class FlatArray {
+ public:
+  FlatArray() = default;
+  FlatArray(std::vector<T> items)
+    : storage_(std::move(items)), data_(storage_.data()), size_(storage_.size()) {}
+
+  static FlatArray View(std::shared_ptr<const void> owner, const T *data, size_t size) {
+    FlatArray array;
+    array.owner_ = std::move(owner);
+    array.data_ = data;
+    array.size_ = size;
+    return array;
+  }
+
+  FlatArray(const FlatArray &other) { *this = other; }
+  FlatArray(FlatArray &&other) noexcept { *this = std::move(other); }
+
+  FlatArray &operator=(const FlatArray &other) {
+    if (this != &other) {
+      storage_ = other.storage_;
+      owner_ = other.owner_;
+      data_ = other.IsView() ? other.data_ : storage_.data();
+      size_ = other.size_;
+    }
+    return *this;
+  }
+
+  FlatArray &operator=(FlatArray &&other) noexcept {
+    if (this != &other) {
+      // moving a vector keeps its buffer, so data_ stays valid
+      storage_ = std::move(other.storage_);
+      owner_ = std::move(other.owner_);
+      data_ = other.data_;
+      size_ = other.size_;
+      other.data_ = nullptr;
+      other.size_ = 0;
+    }
+    return *this;
+  }
+
+  const T &operator[](size_t idx) const { return data_[idx]; }
+  const T *data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const T *begin() const { return data_; }
+  const T *end() const { return data_ + size_; }
+
+ private:
+  bool IsView() const { return owner_ != nullptr; }
+
+  std::vector<T> storage_;
+  std::shared_ptr<const void> owner_;
+  const T *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+
+// Sequence of lists stored in two flat arrays: all items one after another and offsets of the lists
+template <typename T>
+class FlatLists {
+ public:
+  FlatLists() = default;
+  FlatLists(FlatArray<uint64_t> offsets, FlatArray<T> items) : offsets_(std::move(offsets)), items_(std::move(items)) {}
+
+  template <typename Lists>
+  static FlatLists Build(const Lists &lists) {
+    return Build(lists, [](const auto &list) -> const auto & { return list; });
+  }
+
+  // Builds the lists get_list returns for the given objects
+  template <typename Objects, typename GetList>
+  static FlatLists Build(const Objects &objects, GetList get_list) {
+    std::vector<uint64_t> offsets{0};
+    std::vector<T> items;
+    for (const auto &object : objects) {
+      const auto &list = get_list(object);
+      items.insert(items.end(), std::begin(list), std::end(list));
+      offsets.push_back(items.size());
+    }
+    return {std::move(offsets), std::move(items)};
+  }
+
+  Range<const T *> operator[](size_t idx) const {
+    return {items_.data() + offsets_[idx], items_.data() + offsets_[idx + 1]};
+  }
+  size_t size() const { return offsets_.empty() ? 0 : offsets_.size() - 1; }
+
+  const FlatArray<uint64_t> &GetOffsets() const { return offsets_; }
+  const FlatArray<T> &GetItems() const { return items_; }
+
+ private:
+  FlatArray<uint64_t> offsets_;
+  FlatArray<T> items_;
+};
+
+
+// Sorted names in one character buffer; ids of names are their positions
+class StringTable {
+ public:
+  StringTable() = default;
+  explicit StringTable(FlatLists<char> names) : names_(std::move(names)) {}
+
+  template <typename Dict>
+  static StringTable FromKeys(const Dict &dict) {
+    std::vector<std::string_view> names;
+    names.reserve(dict.size());
+    for (const auto &[name, _] : dict) {
+      names.push_back(name);
+    }
+    return FromNames(std::move(names));
+  }
+
+  static StringTable FromNames(std::vector<std::string_view> names) {
+    std::sort(names.begin(), names.end());
+    return StringTable(FlatLists<char>::Build(names));
+  }
+
+  std::string_view operator[](size_t id) const {
+    const auto name = names_[id];
+    return {name.begin(), static_cast<size_t>(name.end() - name.begin())};
+  }
+  size_t size() const { return names_.size(); }
+
+  std::optional<size_t> Find(std::string_view name) const {
+    size_t left = 0;
+    size_t right = size();
+    while (left < right) {
+      const size_t middle = left + (right - left) / 2;
+      if ((*this)[middle] < name) {
+        left = middle + 1;
+      } else {
+        right = middle;
+      }
+    }
+    if (left < size() && (*this)[left] == name) {
+      return left;
+    }
+    return std::nullopt;
+  }
+
+  const FlatLists<char> &GetNames() const { return names_; }
+
+ private:
+  FlatLists<char> names_;
+};
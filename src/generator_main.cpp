@@ -0,0 +1,38 @@
+#include "json.h"
+#include "network_generator.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// Writes a synthetic input for transport_catalog to stdout
+int main(int argc, const char **argv) {
+  try {
+    NetworkGenerator::Params params;
+    for (int arg_idx = 1; arg_idx < argc; ++arg_idx) {
+      const string_view option = argv[arg_idx];
+      if (option == "--help") {
+        cout << "Usage: transport_catalog_generator\n" << NetworkGenerator::PARAMS_USAGE;
+        return 0;
+      }
+      if (arg_idx + 1 == argc) {
+        throw invalid_argument("no value for " + string(option));
+      }
+      if (!NetworkGenerator::ParseParam(option, argv[++arg_idx], params)) {
+        throw invalid_argument("unknown option " + string(option));
+      }
+    }
+
+    Json::Writer writer(cout);
+    Json::WriteNode(Json::Node(NetworkGenerator::GenerateInput(params)), writer);
+    writer.Flush();
+    cout << endl;
+  } catch (const exception &error) {
+    cerr << error.what() << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -1,9 +1,16 @@
 #pragma once
 
+#include "flat_array.h"
+#include "serialization.h"
 #include "utils.h"
 
+#include <cstdint>
 #include <cstdlib>
 #include <deque>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 
 namespace Graph {
@@ -71,4 +78,138 @@ namespace Graph {
     const auto& edges = incidence_lists_[vertex];
     return {edges.begin(), edges.end()};
   }
+
+
+  // Read-only graph in compressed sparse row layout: edges are grouped by their source vertex
+  // and stored in contiguous arrays, so scanning incident edges reads memory sequentially.
+  // Edge ids are positions in these arrays and differ from the ones of the source graph.
+  // A deserialized graph may view the arrays right in a mapped snapshot.
+  template <typename Weight>
+  class CompressedDirectedWeightedGraph {
+  public:
+    using CompactId = uint32_t;
+
+  private:
+    class EdgeIdIterator {
+    public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = EdgeId;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const EdgeId*;
+      using reference = EdgeId;
+
+      explicit EdgeIdIterator(EdgeId edge_id) : edge_id_(edge_id) {}
+      EdgeId operator*() const { return edge_id_; }
+      EdgeIdIterator& operator++() { ++edge_id_; return *this; }
+      bool operator==(const EdgeIdIterator& other) const { return edge_id_ == other.edge_id_; }
+      bool operator!=(const EdgeIdIterator& other) const { return edge_id_ != other.edge_id_; }
+
+    private:
+      EdgeId edge_id_;
+    };
+    using IncidentEdgesRange = Range<EdgeIdIterator>;
+
+  public:
+    CompressedDirectedWeightedGraph() = default;
+    explicit CompressedDirectedWeightedGraph(const DirectedWeightedGraph<Weight>& graph);
+    // Takes the arrays as they are stored: the edges of vertex v are the ones from offsets[v] to offsets[v + 1]
+    CompressedDirectedWeightedGraph(std::vector<CompactId> offsets, std::vector<CompactId> sources,
+                                    std::vector<CompactId> targets, std::vector<Weight> weights);
+
+    void Serialize(std::ostream& output) const;
+    static CompressedDirectedWeightedGraph Deserialize(std::istream& input);
+
+    size_t GetVertexCount() const;
+    size_t GetEdgeCount() const;
+    Edge<Weight> GetEdge(EdgeId edge_id) const;
+    VertexId GetEdgeTarget(EdgeId edge_id) const { return targets_[edge_id]; }
+    Weight GetEdgeWeight(EdgeId edge_id) const { return weights_[edge_id]; }
+    IncidentEdgesRange GetIncidentEdges(VertexId vertex) const;
+
+  private:
+    FlatArray<CompactId> offsets_{std::vector<CompactId>{0}};
+    FlatArray<CompactId> sources_;
+    FlatArray<CompactId> targets_;
+    FlatArray<Weight> weights_;
+  };
+
+
+  template <typename Weight>
+  CompressedDirectedWeightedGraph<Weight>::CompressedDirectedWeightedGraph(const DirectedWeightedGraph<Weight>& graph) {
+    if (graph.GetVertexCount() >= std::numeric_limits<CompactId>::max()
+        || graph.GetEdgeCount() >= std::numeric_limits<CompactId>::max()) {
+      throw std::length_error("graph is too large for 32-bit ids");
+    }
+    const size_t vertex_count = graph.GetVertexCount();
+    const size_t edge_count = graph.GetEdgeCount();
+    std::vector<CompactId> offsets{0};
+    std::vector<CompactId> sources;
+    std::vector<CompactId> targets;
+    std::vector<Weight> weights;
+    offsets.reserve(vertex_count + 1);
+    sources.reserve(edge_count);
+    targets.reserve(edge_count);
+    weights.reserve(edge_count);
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
+        const auto& edge = graph.GetEdge(edge_id);
+        sources.push_back(static_cast<CompactId>(edge.from));
+        targets.push_back(static_cast<CompactId>(edge.to));
+        weights.push_back(edge.weight);
+      }
+      offsets.push_back(static_cast<CompactId>(targets.size()));
+    }
+    offsets_ = std::move(offsets);
+    sources_ = std::move(sources);
+    targets_ = std::move(targets);
+    weights_ = std::move(weights);
+  }
+
+  template <typename Weight>
+  CompressedDirectedWeightedGraph<Weight>::CompressedDirectedWeightedGraph(
+      std::vector<CompactId> offsets, std::vector<CompactId> sources,
+      std::vector<CompactId> targets, std::vector<Weight> weights)
+      : offsets_(std::move(offsets)),
+        sources_(std::move(sources)),
+        targets_(std::move(targets)),
+        weights_(std::move(weights)) {}
+
+  template <typename Weight>
+  void CompressedDirectedWeightedGraph<Weight>::Serialize(std::ostream& output) const {
+    Serialization::Write(output, offsets_);
+    Serialization::Write(output, sources_);
+    Serialization::Write(output, targets_);
+    Serialization::Write(output, weights_);
+  }
+
+  template <typename Weight>
+  CompressedDirectedWeightedGraph<Weight> CompressedDirectedWeightedGraph<Weight>::Deserialize(std::istream& input) {
+    CompressedDirectedWeightedGraph graph;
+    Serialization::Read(input, graph.offsets_);
+    Serialization::Read(input, graph.sources_);
+    Serialization::Read(input, graph.targets_);
+    Serialization::Read(input, graph.weights_);
+    return graph;
+  }
+
+  template <typename Weight>
+  size_t CompressedDirectedWeightedGraph<Weight>::GetVertexCount() const {
+    return offsets_.size() - 1;
+  }
+
+  template <typename Weight>
+  size_t CompressedDirectedWeightedGraph<Weight>::GetEdgeCount() const {
+    return targets_.size();
+  }
+
+  template <typename Weight>
+  Edge<Weight> CompressedDirectedWeightedGraph<Weight>::GetEdge(EdgeId edge_id) const {
+    return {sources_[edge_id], targets_[edge_id], weights_[edge_id]};
+  }
+
+  template <typename Weight>
+  typename CompressedDirectedWeightedGraph<Weight>::IncidentEdgesRange
+  CompressedDirectedWeightedGraph<Weight>::GetIncidentEdges(VertexId vertex) const {
+    return {EdgeIdIterator{offsets_[vertex]}, EdgeIdIterator{offsets_[vertex + 1]}};
+  }
 }
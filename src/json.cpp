@@ -1,97 +1,546 @@
 #include "json.h"
 
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
 using namespace std;
 
 namespace Json {
 
-Node LoadArray(istream& input) {
-  vector<Node> result;
+namespace {
+
+// Recursive descent over a contiguous buffer: strings without escapes are passed
+// to the handler as views of the text, numbers are converted in place
+class Parser {
+ public:
+  Parser(string_view text, Handler &handler)
+      : pos_(text.data()), end_(text.data() + text.size()), handler_(handler) {}
+
+  void ParseDocument() {
+    ParseValue();
+    SkipSpaces();
+    if (pos_ != end_) {
+      Fail("unexpected data after the value");
+    }
+  }
+
+ private:
+  [[noreturn]] static void Fail(const string &reason) {
+    throw runtime_error("invalid JSON: " + reason);
+  }
+
+  void SkipSpaces() {
+    while (pos_ != end_ && (*pos_ == ' ' || *pos_ == '\n' || *pos_ == '\r' || *pos_ == '\t')) {
+      ++pos_;
+    }
+  }
+
+  bool Consume(char c) {
+    if (pos_ != end_ && *pos_ == c) {
+      ++pos_;
+      return true;
+    }
+    return false;
+  }
 
-  for (char c; input >> c && c != ']'; ) {
-    if (c != ',') {
-      input.putback(c);
+  void Expect(char c) {
+    if (!Consume(c)) {
+      Fail(string("expected '") + c + "'");
+    }
+  }
+
+  void ParseValue() {
+    SkipSpaces();
+    if (pos_ == end_) {
+      Fail("unexpected end");
+    }
+    switch (*pos_) {
+      case '[':
+        ParseArray();
+        break;
+      case '{':
+        ParseDict();
+        break;
+      case '"':
+        handler_.String(ParseString());
+        break;
+      case 't':
+        ParseLiteral("true");
+        handler_.Bool(true);
+        break;
+      case 'f':
+        ParseLiteral("false");
+        handler_.Bool(false);
+        break;
+      default:
+        ParseNumber();
+    }
+  }
+
+  void ParseArray() {
+    ++pos_;  // '['
+    handler_.StartArray();
+    SkipSpaces();
+    if (!Consume(']')) {
+      do {
+        ParseValue();
+        SkipSpaces();
+      } while (Consume(','));
+      Expect(']');
+    }
+    handler_.EndArray();
+  }
+
+  void ParseDict() {
+    ++pos_;  // '{'
+    handler_.StartDict();
+    SkipSpaces();
+    if (!Consume('}')) {
+      do {
+        SkipSpaces();
+        handler_.Key(ParseString());
+        SkipSpaces();
+        Expect(':');
+        ParseValue();
+        SkipSpaces();
+      } while (Consume(','));
+      Expect('}');
+    }
+    handler_.EndDict();
+  }
+
+  void ParseLiteral(string_view literal) {
+    if (static_cast<size_t>(end_ - pos_) < literal.size() || string_view(pos_, literal.size()) != literal) {
+      Fail("unknown literal");
+    }
+    pos_ += literal.size();
+  }
+
+  string_view ParseString() {
+    Expect('"');
+    const char *begin = pos_;
+    const auto *quote = static_cast<const char *>(memchr(pos_, '"', end_ - pos_));
+    if (!quote) {
+      Fail("unterminated string");
+    }
+    if (!memchr(begin, '\\', quote - begin)) {
+      pos_ = quote + 1;
+      return {begin, static_cast<size_t>(quote - begin)};
     }
-    result.push_back(LoadNode(input));
+    return ParseEscapedString();
+  }
+
+  string_view ParseEscapedString() {
+    buffer_.clear();
+    while (true) {
+      if (pos_ == end_) {
+        Fail("unterminated string");
+      }
+      const char c = *pos_++;
+      if (c == '"') {
+        return buffer_;
+      } else if (c != '\\') {
+        buffer_.push_back(c);
+        continue;
+      }
+      if (pos_ == end_) {
+        Fail("unterminated string");
+      }
+      switch (const char escaped = *pos_++) {
+        case '"':
+        case '\\':
+        case '/':
+          buffer_.push_back(escaped);
+          break;
+        case 'b':
+          buffer_.push_back('\b');
+          break;
+        case 'f':
+          buffer_.push_back('\f');
+          break;
+        case 'n':
+          buffer_.push_back('\n');
+          break;
+        case 'r':
+          buffer_.push_back('\r');
+          break;
+        case 't':
+          buffer_.push_back('\t');
+          break;
+        case 'u':
+          AppendUtf8(ParseCodePoint());
+          break;
+        default:
+          Fail("unknown escape sequence");
+      }
+    }
+  }
+
+  uint32_t ParseHexQuad() {
+    uint32_t value = 0;
+    if (end_ - pos_ < 4 || from_chars(pos_, pos_ + 4, value, 16).ptr != pos_ + 4) {
+      Fail("invalid unicode escape");
+    }
+    pos_ += 4;
+    return value;
+  }
+
+  uint32_t ParseCodePoint() {
+    const uint32_t code_point = ParseHexQuad();
+    if (code_point < 0xD800 || code_point > 0xDBFF) {
+      return code_point;
+    }
+    // high surrogate, the low one follows
+    if (end_ - pos_ < 2 || pos_[0] != '\\' || pos_[1] != 'u') {
+      Fail("unpaired surrogate");
+    }
+    pos_ += 2;
+    const uint32_t low_surrogate = ParseHexQuad();
+    return 0x10000 + ((code_point - 0xD800) << 10) + (low_surrogate - 0xDC00);
+  }
+
+  void AppendUtf8(uint32_t code_point) {
+    if (code_point < 0x80) {
+      buffer_.push_back(static_cast<char>(code_point));
+    } else if (code_point < 0x800) {
+      buffer_.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+      buffer_.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x10000) {
+      buffer_.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+      buffer_.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+      buffer_.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else {
+      buffer_.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+      buffer_.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+      buffer_.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+      buffer_.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+  }
+
+  void CheckNumber(from_chars_result result) const {
+    if (result.ec != errc() || result.ptr != pos_) {
+      Fail("invalid number");
+    }
+  }
+
+  // Numbers without a fraction or an exponent are ints
+  void ParseNumber() {
+    const char *begin = pos_;
+    bool is_int = true;
+    Consume('-');
+    for (; pos_ != end_; ++pos_) {
+      const char c = *pos_;
+      if (c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-') {
+        is_int = false;
+      } else if (c < '0' || c > '9') {
+        break;
+      }
+    }
+    if (is_int) {
+      int value = 0;
+      CheckNumber(from_chars(begin, pos_, value));
+      handler_.Int(value);
+    } else {
+      double value = 0;
+      CheckNumber(from_chars(begin, pos_, value));
+      handler_.Double(value);
+    }
+  }
+
+  const char *pos_;
+  const char *end_;
+  Handler &handler_;
+  string buffer_;
+};
+}
+
+void Parse(string_view text, Handler &handler) {
+  Parser(text, handler).ParseDocument();
+}
+
+void TreeBuilder::StartArray() {
+  if (item_handler_) {
+    ++item_depth_;
+    item_handler_->StartArray();
+    return;
+  }
+  stack_.push_back({Array{}, {}});
+  if (stack_.size() == 2 && holds_alternative<Dict>(stack_.front().value)) {
+    if (auto it = root_array_handlers_.find(stack_.front().key); it != root_array_handlers_.end()) {
+      item_handler_ = it->second;
+    }
+  }
+}
+
+void TreeBuilder::EndArray() {
+  if (item_handler_ && item_depth_ > 0) {
+    --item_depth_;
+    item_handler_->EndArray();
+    return;
   }
+  item_handler_ = nullptr;
+  EndContainer();
+}
 
-  return Node(move(result));
+void TreeBuilder::StartDict() {
+  if (item_handler_) {
+    ++item_depth_;
+    item_handler_->StartDict();
+    return;
+  }
+  stack_.push_back({Dict{}, {}});
 }
 
-Node LoadBool(istream& input) {
-  string s;
-  while (isalpha(input.peek())) {
-    s.push_back(input.get());
+void TreeBuilder::EndDict() {
+  if (item_handler_) {
+    --item_depth_;
+    item_handler_->EndDict();
+    return;
   }
-  return Node(s == "true");
+  EndContainer();
 }
 
-Node LoadNumber(istream& input) {
-  bool is_negative = false;
-  if (input.peek() == '-') {
-    is_negative = true;
-    input.get();
+void TreeBuilder::Key(string_view key) {
+  if (item_handler_) {
+    item_handler_->Key(key);
+    return;
   }
-  int int_part = 0;
-  while (isdigit(input.peek())) {
-    int_part *= 10;
-    int_part += input.get() - '0';
+  stack_.back().key = key;
+}
+
+void TreeBuilder::String(string_view value) {
+  if (item_handler_) {
+    item_handler_->String(value);
+    return;
   }
-  if (input.peek() != '.') {
-    return Node(int_part * (is_negative ? -1 : 1));
+  AddNode(Node(string(value)));
+}
+
+void TreeBuilder::Int(int value) {
+  if (item_handler_) {
+    item_handler_->Int(value);
+    return;
   }
-  input.get();  // '.'
-  double result = int_part;
-  double frac_mult = 0.1;
-  while (isdigit(input.peek())) {
-    result += frac_mult * (input.get() - '0');
-    frac_mult /= 10;
+  AddNode(Node(value));
+}
+
+void TreeBuilder::Double(double value) {
+  if (item_handler_) {
+    item_handler_->Double(value);
+    return;
   }
-  return Node(result * (is_negative ? -1 : 1));
+  AddNode(Node(value));
 }
 
-Node LoadString(istream& input) {
-  string line;
-  getline(input, line, '"');
-  return Node(move(line));
+void TreeBuilder::Bool(bool value) {
+  if (item_handler_) {
+    item_handler_->Bool(value);
+    return;
+  }
+  AddNode(Node(value));
 }
 
-Node LoadDict(istream& input) {
-  Dict result;
+void TreeBuilder::EndContainer() {
+  Container container = move(stack_.back());
+  stack_.pop_back();
+  AddNode(visit([](auto &value) { return Node(move(value)); }, container.value));
+}
 
-  for (char c; input >> c && c != '}'; ) {
-    if (c == ',') {
-      input >> c;
-    }
+void TreeBuilder::AddNode(Node node) {
+  if (stack_.empty()) {
+    root_ = move(node);
+    return;
+  }
+  Container &container = stack_.back();
+  if (auto *array = get_if<Array>(&container.value)) {
+    array->push_back(move(node));
+  } else {
+    get<Dict>(container.value).emplace(move(container.key), move(node));
+  }
+}
 
-    string key = LoadString(input).AsString();
-    input >> c;
-    result.emplace(move(key), LoadNode(input));
+Node TreeBuilder::ExtractRoot() {
+  if (!root_) {
+    throw runtime_error("invalid JSON: no value");
   }
+  return move(*root_);
+}
+
+Writer::Writer(ostream &output, optional<int> precision) : output_(output), precision_(precision) {
+  buffer_.reserve(FLUSH_SIZE * 2);
+}
+
+Writer::~Writer() {
+  Flush();
+}
 
-  return Node(move(result));
+void Writer::Flush() {
+  output_.write(buffer_.data(), static_cast<streamsize>(buffer_.size()));
+  buffer_.clear();
 }
 
-Node LoadNode(istream& input) {
-  char c;
-  input >> c;
+void Writer::FlushIfFull() {
+  if (buffer_.size() >= FLUSH_SIZE) {
+    Flush();
+  }
+}
 
-  if (c == '[') {
-    return LoadArray(input);
-  } else if (c == '{') {
-    return LoadDict(input);
-  } else if (c == '"') {
-    return LoadString(input);
-  } else if (c == 't' || c == 'f') {
-    input.putback(c);
-    return LoadBool(input);
+void Writer::StartValue() {
+  if (is_after_key_) {
+    is_after_key_ = false;
   } else {
-    input.putback(c);
-    return LoadNumber(input);
+    if (has_items_.back()) {
+      buffer_ += ", ";
+    }
+    has_items_.back() = true;
   }
 }
 
-Document Load(istream& input) {
-  return Document{LoadNode(input)};
+void Writer::StartArray() {
+  StartValue();
+  buffer_.push_back('[');
+  has_items_.push_back(false);
+}
+
+void Writer::EndArray() {
+  has_items_.pop_back();
+  buffer_.push_back(']');
+  FlushIfFull();
+}
+
+void Writer::StartDict() {
+  StartValue();
+  buffer_.push_back('{');
+  has_items_.push_back(false);
+}
+
+void Writer::EndDict() {
+  has_items_.pop_back();
+  buffer_.push_back('}');
+  FlushIfFull();
+}
+
+void Writer::Key(string_view key) {
+  StartValue();
+  WriteEscaped(key);
+  buffer_ += ": ";
+  is_after_key_ = true;
+}
+
+void Writer::String(string_view value) {
+  StartValue();
+  WriteEscaped(value);
+  FlushIfFull();
+}
+
+void Writer::Int(int value) {
+  StartValue();
+  char chars[16];
+  buffer_.append(chars, to_chars(begin(chars), end(chars), value).ptr);
+}
+
+void Writer::Double(double value) {
+  StartValue();
+  char chars[64];
+  const auto result = precision_
+      ? to_chars(begin(chars), end(chars), value, chars_format::general, *precision_)
+      : to_chars(begin(chars), end(chars), value);
+  buffer_.append(chars, result.ptr);
+}
+
+void Writer::Bool(bool value) {
+  StartValue();
+  buffer_ += value ? "true" : "false";
+}
+
+void Writer::Raw(string_view values) {
+  if (values.empty()) {
+    return;
+  }
+  StartValue();
+  buffer_.append(values);
+  FlushIfFull();
+}
+
+void Writer::WriteEscaped(string_view value) {
+  static const char hex_digits[] = "0123456789abcdef";
+  buffer_.push_back('"');
+  size_t run_begin = 0;
+  for (size_t i = 0; i < value.size(); ++i) {
+    const auto c = static_cast<unsigned char>(value[i]);
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      continue;
+    }
+    buffer_.append(value.data() + run_begin, i - run_begin);
+    run_begin = i + 1;
+    buffer_.push_back('\\');
+    switch (c) {
+      case '"':
+      case '\\':
+        buffer_.push_back(static_cast<char>(c));
+        break;
+      case '\n':
+        buffer_.push_back('n');
+        break;
+      case '\r':
+        buffer_.push_back('r');
+        break;
+      case '\t':
+        buffer_.push_back('t');
+        break;
+      default:
+        buffer_ += "u00";
+        buffer_.push_back(hex_digits[c >> 4]);
+        buffer_.push_back(hex_digits[c & 0xF]);
+    }
+  }
+  buffer_.append(value.data() + run_begin, value.size() - run_begin);
+  buffer_.push_back('"');
+}
+
+void WriteNode(const Node &node, Handler &handler) {
+  if (node.IsArray()) {
+    handler.StartArray();
+    for (const Node &item : node.AsArray()) {
+      WriteNode(item, handler);
+    }
+    handler.EndArray();
+  } else if (node.IsMap()) {
+    handler.StartDict();
+    for (const auto &[key, value] : node.AsMap()) {
+      handler.Key(key);
+      WriteNode(value, handler);
+    }
+    handler.EndDict();
+  } else if (node.IsInt()) {
+    handler.Int(node.AsInt());
+  } else if (node.IsDouble()) {
+    handler.Double(node.AsDouble());
+  } else if (node.IsBool()) {
+    handler.Bool(node.AsBool());
+  } else {
+    handler.String(node.AsString());
+  }
+}
+
+string ReadAll(istream &input) {
+  string text;
+  char buffer[1 << 16];
+  while (input.read(buffer, sizeof(buffer)) || input.gcount() > 0) {
+    text.append(buffer, input.gcount());
+  }
+  return text;
+}
+
+Document Load(string_view text, map<string, Handler *> root_array_handlers) {
+  TreeBuilder builder(move(root_array_handlers));
+  Parse(text, builder);
+  return Document{builder.ExtractRoot()};
+}
+
+Document Load(istream &input, map<string, Handler *> root_array_handlers) {
+  return Load(ReadAll(input), move(root_array_handlers));
 }
 
 ostream &operator<<(ostream &output, const string &str) {
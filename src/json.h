@@ -3,7 +3,9 @@
 #include "utils.h"
 #include <iostream>
 #include <map>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -50,8 +52,107 @@ namespace Json {
     Node root;
   };
 
-  Node LoadNode(std::istream& input);
-  Document Load(std::istream& input);
+  // Receives events of Parse in document order. Strings may point into the parsed text
+  // or into a parser buffer, so they are valid only during the call.
+  class Handler {
+  public:
+    virtual ~Handler() = default;
+
+    virtual void StartArray() = 0;
+    virtual void EndArray() = 0;
+    virtual void StartDict() = 0;
+    virtual void EndDict() = 0;
+    virtual void Key(std::string_view key) = 0;
+    virtual void String(std::string_view value) = 0;
+    virtual void Int(int value) = 0;
+    virtual void Double(double value) = 0;
+    virtual void Bool(bool value) = 0;
+  };
+
+  void Parse(std::string_view text, Handler& handler);
+
+  // Builds nodes from parsing events. Events of the items of the root dict arrays which have
+  // handlers go right to them, so those items never become nodes; the arrays are left empty.
+  class TreeBuilder : public Handler {
+  public:
+    TreeBuilder() = default;
+    explicit TreeBuilder(std::map<std::string, Handler*> root_array_handlers)
+        : root_array_handlers_(move(root_array_handlers)) {}
+
+    void StartArray() override;
+    void EndArray() override;
+    void StartDict() override;
+    void EndDict() override;
+    void Key(std::string_view key) override;
+    void String(std::string_view value) override;
+    void Int(int value) override;
+    void Double(double value) override;
+    void Bool(bool value) override;
+
+    Node ExtractRoot();
+
+  private:
+    struct Container {
+      std::variant<Array, Dict> value;
+      std::string key;  // of the dict item being parsed
+    };
+
+    void AddNode(Node node);
+    void EndContainer();
+
+    std::map<std::string, Handler*> root_array_handlers_;
+    // handler of the root array being parsed and the depth of the containers open in its items
+    Handler* item_handler_ = nullptr;
+    size_t item_depth_ = 0;
+    std::vector<Container> stack_;
+    std::optional<Node> root_;
+  };
+
+  // Serializes events right into a buffer which is flushed to the stream in large chunks,
+  // with proper string escaping. Doubles are written with the given number of significant
+  // digits like printf("%.*g"), or in the shortest form which reads back exactly if it is not set.
+  class Writer : public Handler {
+  public:
+    explicit Writer(std::ostream& output, std::optional<int> precision = std::nullopt);
+    ~Writer() override;
+
+    void StartArray() override;
+    void EndArray() override;
+    void StartDict() override;
+    void EndDict() override;
+    void Key(std::string_view key) override;
+    void String(std::string_view value) override;
+    void Int(int value) override;
+    void Double(double value) override;
+    void Bool(bool value) override;
+    // Writes values serialized by another writer as the next items
+    void Raw(std::string_view values);
+
+    void Flush();
+    std::optional<int> GetPrecision() const { return precision_; }
+
+  private:
+    static const size_t FLUSH_SIZE = 1 << 16;
+
+    void StartValue();
+    void WriteEscaped(std::string_view value);
+    void FlushIfFull();
+
+    std::ostream& output_;
+    std::optional<int> precision_;
+    std::string buffer_;
+    // for the top level and every open container whether it has items already;
+    // top level values are separated like array items
+    std::vector<bool> has_items_{false};
+    bool is_after_key_ = false;
+  };
+
+  // Emits events describing the node
+  void WriteNode(const Node& node, Handler& handler);
+
+  std::string ReadAll(std::istream& input);
+  Document Load(std::string_view text, std::map<std::string, Handler*> root_array_handlers = {});
+  Document Load(std::istream& input, std::map<std::string, Handler*> root_array_handlers = {});
 
   std::ostream &operator<<(std::ostream &output, const std::string &s);
   std::ostream &operator<<(std::ostream &output, const Node &node);
@@ -1,4 +1,5 @@
 #include "location.h"
+#include <stdexcept>
 #include <tuple>
 
 using namespace std;
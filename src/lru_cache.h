@@ -0,0 +1,54 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+// Keeps at most capacity values, dropping the least recently used one; safe to share between threads
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache {
+ public:
+  explicit LruCache(size_t capacity) : capacity_(std::max<size_t>(capacity, 1)) {}
+
+  std::optional<Value> Find(const Key &key) {
+    std::lock_guard guard(mutex_);
+    const auto it = positions_.find(key);
+    if (it == positions_.end()) {
+      return std::nullopt;
+    }
+    items_.splice(items_.begin(), items_, it->second);
+    return it->second->second;
+  }
+
+  void Put(const Key &key, Value value) {
+    std::lock_guard guard(mutex_);
+    if (const auto it = positions_.find(key); it != positions_.end()) {
+      it->second->second = std::move(value);
+      items_.splice(items_.begin(), items_, it->second);
+      return;
+    }
+    items_.emplace_front(key, std::move(value));
+    positions_.emplace(key, items_.begin());
+    if (items_.size() > capacity_) {
+      positions_.erase(items_.back().first);
+      items_.pop_back();
+    }
+  }
+
+  size_t size() const {
+    std::lock_guard guard(mutex_);
+    return items_.size();
+  }
+
+ private:
+  using Items = std::list<std::pair<Key, Value>>;
+
+  const size_t capacity_;
+  mutable std::mutex mutex_;
+  Items items_;  // the most recently used first
+  std::unordered_map<Key, typename Items::iterator, Hash> positions_;
+};
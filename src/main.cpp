@@ -1,28 +1,198 @@
 #include "json.h"
+#include "serialization.h"
 #include "transport_data.h"
 #include "transport_informer.h"
 #include "transport_database.h"
 #include "map_builder.h"
+#include "profiler.h"
+#include "server.h"
 
-#include <iomanip>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 using namespace std;
 using namespace TransportDatabase;
 using namespace TransportInformer;
 
-int main() {
-  const Json::Dict input = Json::Load(cin).GetRoot().AsMap();
+// significant digits of numbers in responses
+const int RESPONSE_PRECISION = 6;
+// file for the report of times of the phases of a run, "-" for stderr; nothing is measured if it's not set
+const char *const PROFILE_VARIABLE = "TRANSPORT_CATALOG_PROFILE";
+const char *const USAGE = "Usage: transport_catalog [make_base|process_requests|serve [SOCKET]]\n";
 
-  const Json::Array &database_input = input.at("base_requests").AsArray();
+size_t GetThreadCount() {
+  return max(thread::hardware_concurrency(), 1u);
+}
+
+const string &GetSnapshotFile(const Json::Dict &input) {
+  return input.at("serialization_settings").AsMap().at("file").AsString();
+}
+
+void PrintResponses(const Database &db, const shared_ptr<Visualisation::MapBuilder> &map_builder,
+                    const vector<Requests::StatRequest> &stat_requests) {
+  Profiler::ScopedTimer timer("responses");
+  Informer informer(map_builder, GetThreadCount());
+  Json::Writer writer(cout, RESPONSE_PRECISION);
+  informer.ProcessRequests(db, stat_requests, writer);
+  writer.Flush();
+  cout << endl;
+}
+
+// the router may still be being built in the background when it returns
+Database BuildDatabase(TransportData::Data data, const Json::Dict &routing_settings) {
+  Profiler::ScopedTimer timer("database");
+  return Database(move(data), routing_settings, GetThreadCount());
+}
+
+TransportData::Data BuildData(TransportData::DataBuilder &&data_builder) {
+  Profiler::ScopedTimer timer("data_build");
+  return move(data_builder).Build();
+}
+
+void WriteProfile(const string &file) {
+  ofstream file_output;
+  if (file != "-") {
+    file_output.open(file);
+  }
+  ostream &output = file != "-" ? file_output : cerr;
+  {
+    Json::Writer writer(output);
+    Profiler::WriteReport(writer);
+  }
+  output << endl;
+}
+
+// Builds the database and the map from base_requests and saves them to the snapshot file;
+// the map is rendered while the router is being built
+void MakeBase(const Json::Dict &input, TransportData::Data data) {
+  const Json::Dict &routing_settings = input.at("routing_settings").AsMap();
+  Database db = BuildDatabase(move(data), routing_settings);
+  const Json::Dict &render_settings = input.at("render_settings").AsMap();
+  Visualisation::MapBuilder map_builder(db, render_settings);
+  map_builder.Render();
+
+  Profiler::ScopedTimer timer("snapshot_write");
+  ofstream output(GetSnapshotFile(input), ios::binary);
+  Serialization::WriteHeader(output);
+  db.Serialize(output);
+  map_builder.Serialize(output);
+  if (!output) {
+    throw runtime_error("can't write database snapshot");
+  }
+}
+
+// Maps the snapshot file and passes the database and the map restored right from it to use
+void UseSnapshot(const Json::Dict &input,
+                 const function<void(const Database &, const shared_ptr<Visualisation::MapBuilder> &)> &use) {
+  Serialization::MemoryBuffer buffer(make_shared<const Serialization::MappedFile>(GetSnapshotFile(input)));
+  istream snapshot(&buffer);
+  optional<Profiler::ScopedTimer> timer(in_place, "snapshot_read");
+  Serialization::CheckHeader(snapshot);
+  const Database db = Database::Deserialize(snapshot);
+  auto map_builder = make_shared<Visualisation::MapBuilder>(db, snapshot);
+  timer.reset();
+  use(db, map_builder);
+}
+
+// Answers stat_requests right from the snapshot file
+void ProcessRequests(const Json::Dict &input, const vector<Requests::StatRequest> &stat_requests) {
+  UseSnapshot(input, [&stat_requests](const Database &db, const shared_ptr<Visualisation::MapBuilder> &map_builder) {
+    PrintResponses(db, map_builder, stat_requests);
+  });
+}
+
+// Builds the database and answers stat_requests in one run
+void MakeBaseAndProcessRequests(const Json::Dict &input, TransportData::Data data,
+                                const vector<Requests::StatRequest> &stat_requests) {
+  const Json::Dict &routing_settings = input.at("routing_settings").AsMap();
+  Database db = BuildDatabase(move(data), routing_settings);
+
+  const Json::Dict &render_settings = input.at("render_settings").AsMap();
+  PrintResponses(db, make_shared<Visualisation::MapBuilder>(db, render_settings), stat_requests);
+}
+
+// Answers requests coming one per line on stdin, or on connections to the Unix socket if its path is given
+void Serve(const Database &db, const shared_ptr<Visualisation::MapBuilder> &map_builder, const char *socket_path) {
+  map_builder->Render();
+  const Informer informer(map_builder);
+  if (socket_path) {
+    Server::ServeUnixSocket(socket_path, db, informer, RESPONSE_PRECISION);
+  } else {
+    Server::Serve(db, informer, cin, cout, RESPONSE_PRECISION);
+  }
+}
+
+// Builds the database and the map once and serves requests until the input ends
+void MakeBaseAndServe(const Json::Dict &input, TransportData::Data data, const char *socket_path) {
   const Json::Dict &routing_settings = input.at("routing_settings").AsMap();
-  Database db(TransportData::ReadData(database_input), routing_settings);
+  Database db = BuildDatabase(move(data), routing_settings);
 
   const Json::Dict &render_settings = input.at("render_settings").AsMap();
-  Informer informer(make_shared<Visualisation::MapBuilder>(db, render_settings));
-  const Json::Array &info_requests = input.at("stat_requests").AsArray();
-  cout << setprecision(6);
-  cout << informer.ProcessRequests(db, info_requests) << endl;
+  Serve(db, make_shared<Visualisation::MapBuilder>(db, render_settings), socket_path);
+}
+
+int main(int argc, const char *argv[]) {
+  const string_view mode = argc >= 2 ? argv[1] : "";
+  if (argc > 3 || (argc == 3 && mode != "serve")) {
+    cerr << USAGE;
+    return 5;
+  }
+
+  const char *const profile_file = getenv(PROFILE_VARIABLE);
+  if (profile_file) {
+    Profiler::Enable();
+  }
+  optional<Profiler::ScopedTimer> total_timer(in_place, "total");
+
+  // base and stat requests are read right from parsing events into stops, buses and typed requests,
+  // only the settings become nodes; a server takes the input from the first line and requests
+  // from the following ones
+  TransportData::DataBuilder data_builder;
+  Requests::StatRequestsBuilder stat_requests_builder;
+  map<string, Json::Handler *> handlers{
+      {"base_requests", &data_builder},
+      {"stat_requests", &stat_requests_builder},
+  };
+  optional<Profiler::ScopedTimer> load_timer(in_place, "json_load");
+  string input_line;
+  const Json::Document document = mode == "serve" && getline(cin, input_line)
+      ? Json::Load(input_line, move(handlers))
+      : Json::Load(cin, move(handlers));
+  load_timer.reset();
+  const Json::Dict &input = document.GetRoot().AsMap();
+  const vector<Requests::StatRequest> stat_requests = move(stat_requests_builder).Build();
+  if (mode.empty()) {
+    MakeBaseAndProcessRequests(input, BuildData(move(data_builder)), stat_requests);
+  } else if (mode == "make_base") {
+    MakeBase(input, BuildData(move(data_builder)));
+  } else if (mode == "process_requests") {
+    ProcessRequests(input, stat_requests);
+  } else if (mode == "serve") {
+    // without base_requests the database is taken from the snapshot file
+    const char *const socket_path = argc == 3 ? argv[2] : nullptr;
+    if (input.count("base_requests") > 0) {
+      MakeBaseAndServe(input, BuildData(move(data_builder)), socket_path);
+    } else {
+      UseSnapshot(input, [socket_path](const Database &db, const shared_ptr<Visualisation::MapBuilder> &map_builder) {
+        Serve(db, map_builder, socket_path);
+      });
+    }
+  } else {
+    cerr << USAGE;
+    return 5;
+  }
 
+  total_timer.reset();
+  if (profile_file) {
+    WriteProfile(profile_file);
+  }
   return 0;
 }
@@ -1,7 +1,11 @@
 #include "map_builder.h"
+#include "profiler.h"
+#include "serialization.h"
 #include "cctype"
+#include <optional>
 #include <set>
-#include <sstream>
+#include <stdexcept>
+#include <string>
 
 using namespace std;
 
@@ -61,124 +65,425 @@ RenderSettings ParseRenderSettings(const Json::Dict &render_settings) {
   return result;
 }
 
-string EscapeSpecialCharacters(const string &input) {
-  string output;
-  for (const char c : input) {
-    if (c == '"' || c == '\\') {
-      //output.push_back('\\');
-    }
-    output.push_back(c);
+void Write(ostream &output, const RenderSettings &settings) {
+  auto write_color = [&output](const Svg::Color &color) { Serialization::Write(output, color.color_string); };
+  Serialization::Write(output, settings.width);
+  Serialization::Write(output, settings.height);
+  Serialization::Write(output, settings.padding);
+  Serialization::Write(output, settings.layers);
+  Serialization::Write(output, settings.stop_radius);
+  Serialization::Write(output, settings.line_width);
+  Serialization::Write(output, static_cast<uint64_t>(settings.color_palette.size()));
+  for (const Svg::Color &color : settings.color_palette) {
+    write_color(color);
   }
-  return output;
+  Serialization::Write(output, settings.stop_label_font_size);
+  Serialization::Write(output, settings.stop_label_offset);
+  Serialization::Write(output, settings.bus_label_font_size);
+  Serialization::Write(output, settings.bus_label_offset);
+  write_color(settings.underlayer_color);
+  Serialization::Write(output, settings.undrlayer_width);
+}
+
+void Read(istream &input, RenderSettings &settings) {
+  auto read_color = [&input]() { return Svg::Color(Serialization::Read<string>(input)); };
+  Serialization::Read(input, settings.width);
+  Serialization::Read(input, settings.height);
+  Serialization::Read(input, settings.padding);
+  Serialization::Read(input, settings.layers);
+  Serialization::Read(input, settings.stop_radius);
+  Serialization::Read(input, settings.line_width);
+  settings.color_palette.resize(Serialization::Read<uint64_t>(input));
+  for (Svg::Color &color : settings.color_palette) {
+    color = read_color();
+  }
+  Serialization::Read(input, settings.stop_label_font_size);
+  Serialization::Read(input, settings.stop_label_offset);
+  Serialization::Read(input, settings.bus_label_font_size);
+  Serialization::Read(input, settings.bus_label_offset);
+  settings.underlayer_color = read_color();
+  Serialization::Read(input, settings.undrlayer_width);
 }
 
 MapBuilder::MapBuilder(const TransportDatabase::Database &db, const Json::Dict &render_settings)
-  : settings_(ParseRenderSettings(render_settings)),
-    projector_(make_unique<UniformProjector>(db, settings_.width, settings_.height, settings_.padding)),
-    db_(db), bus_names_(SortNames(db.GetBusesData())), stop_names_(SortNames(db.GetStopsData())) {
-  DrawLayers();
-  ostringstream stream;
-  doc_.Render(stream);
-  map_ = EscapeSpecialCharacters(stream.str());
+  : settings_(ParseRenderSettings(render_settings)), db_(db) {
+  ComputeBusLabelColors();
+}
+
+MapBuilder::MapBuilder(const TransportDatabase::Database &db, istream &input)
+  : settings_(Serialization::Read<RenderSettings>(input)), db_(db),
+    projector_(make_unique<PrecomputedProjector>(Serialization::Read<vector<Svg::Point>>(input))),
+    map_(Serialization::Read<string>(input)) {
+  call_once(map_rendered_, [] {});
+  ComputeBusLabelColors();
 }
 
-void MapBuilder::DrawLayers() {
+void MapBuilder::Serialize(ostream &output) const {
+  Render();
+  Write(output, settings_);
+  vector<Svg::Point> stop_projection;
+  stop_projection.reserve(db_.GetStopCount());
+  for (TransportData::StopId stop_id = 0; stop_id < db_.GetStopCount(); ++stop_id) {
+    stop_projection.push_back(projector_->ProjectStop(stop_id));
+  }
+  Serialization::Write(output, stop_projection);
+  Serialization::Write(output, map_);
+}
+
+void MapBuilder::Render() const {
+  call_once(map_rendered_, [this] {
+    {
+      Profiler::ScopedTimer timer("map.projection");
+      projector_ = make_unique<UniformProjector>(db_, settings_.width, settings_.height, settings_.padding);
+    }
+    Profiler::ScopedTimer timer("map.svg");
+    Svg::Writer svg;
+    DrawLayers(svg);
+    map_ = move(svg).Finish();
+    Profiler::AddCount("map_bytes", map_.size());
+  });
+}
+
+const string &MapBuilder::GetMap() const {
+  Render();
+  return map_;
+}
+
+shared_ptr<const string> MapBuilder::GetTile(const TileId &tile) const {
+  if (tile.zoom > MAX_TILE_ZOOM || tile.x >= (1u << tile.zoom) || tile.y >= (1u << tile.zoom)) {
+    return nullptr;
+  }
+  if (auto cached_tile = tiles_.Find(tile)) {
+    return move(*cached_tile);
+  }
+  auto rendered_tile = make_shared<const string>(RenderTile(tile));
+  tiles_.Put(tile, rendered_tile);
+  return rendered_tile;
+}
+
+MapBuilder::ElementKind MapBuilder::GetLayerKind(const string &layer) {
+  if (layer == "bus_lines") {
+    return ElementKind::BUS_LINE;
+  } else if (layer == "bus_labels") {
+    return ElementKind::BUS_LABEL;
+  } else if (layer == "stop_points") {
+    return ElementKind::STOP_POINT;
+  } else if (layer == "stop_labels") {
+    return ElementKind::STOP_LABEL;
+  } else {
+    throw runtime_error("unknown map layer");
+  }
+}
+
+// Text size is not measured, so a label is taken to be as wide as its font size per byte
+Rect MapBuilder::GetLabelBounds(Svg::Point point, Svg::Point offset, int font_size, string_view text) const {
+  const double margin = settings_.undrlayer_width / 2;
+  const Svg::Point anchor{point.x + offset.x, point.y + offset.y};
+  return {
+      {anchor.x - margin, anchor.y - font_size - margin},
+      {anchor.x + static_cast<double>(font_size * text.size()) + margin, anchor.y + font_size + margin},
+  };
+}
+
+void MapBuilder::ComputeBusLabelColors() {
+  bus_label_color_ids_.assign(db_.GetBusCount(), 0);
+  size_t color_id = 0;
+  for (TransportData::BusId bus_id = 0; bus_id < db_.GetBusCount(); ++bus_id) {
+    if (!db_.GetBusStopIds(bus_id).empty())
+      bus_label_color_ids_[bus_id] = color_id++;
+  }
+}
+
+const Svg::Color &MapBuilder::GetBusLabelColor(TransportData::BusId bus_id) const {
+  return settings_.color_palette[bus_label_color_ids_[bus_id] % settings_.color_palette.size()];
+}
+
+void MapBuilder::IndexElements() const {
+  vector<Rect> bounds;
+  const double line_margin = settings_.line_width / 2;
+  for (TransportData::BusId bus_id = 0; bus_id < db_.GetBusCount(); ++bus_id) {
+    const auto stops = db_.GetBusStopIds(bus_id);
+    for (uint32_t stop_idx = 0; stop_idx + 1 < stops.size(); ++stop_idx) {
+      const Svg::Point from = projector_->ProjectStop(stops[stop_idx]);
+      const Svg::Point to = projector_->ProjectStop(stops[stop_idx + 1]);
+      elements_.push_back({ElementKind::BUS_LINE, bus_id, stop_idx});
+      bounds.push_back({{min(from.x, to.x) - line_margin, min(from.y, to.y) - line_margin},
+                        {max(from.x, to.x) + line_margin, max(from.y, to.y) + line_margin}});
+    }
+  }
+
+  for (TransportData::BusId bus_id = 0; bus_id < db_.GetBusCount(); ++bus_id) {
+    const auto stops = db_.GetBusStopIds(bus_id);
+    if (stops.empty())
+      continue;
+    vector<uint32_t> label_stop_indices{0};
+    const uint32_t last_stop_idx = stops.size() / 2;
+    if (!db_.IsRoundtrip(bus_id) && stops[last_stop_idx] != stops[0])
+      label_stop_indices.push_back(last_stop_idx);
+    for (const uint32_t stop_idx : label_stop_indices) {
+      elements_.push_back({ElementKind::BUS_LABEL, bus_id, stop_idx});
+      bounds.push_back(GetLabelBounds(projector_->ProjectStop(stops[stop_idx]), settings_.bus_label_offset,
+                                      settings_.bus_label_font_size, db_.GetBusName(bus_id)));
+    }
+  }
+
+  for (TransportData::StopId stop_id = 0; stop_id < db_.GetStopCount(); ++stop_id) {
+    const Svg::Point point = projector_->ProjectStop(stop_id);
+    const double radius = settings_.stop_radius;
+    elements_.push_back({ElementKind::STOP_POINT, stop_id, 0});
+    bounds.push_back({{point.x - radius, point.y - radius}, {point.x + radius, point.y + radius}});
+  }
+  for (TransportData::StopId stop_id = 0; stop_id < db_.GetStopCount(); ++stop_id) {
+    elements_.push_back({ElementKind::STOP_LABEL, stop_id, 0});
+    bounds.push_back(GetLabelBounds(projector_->ProjectStop(stop_id), settings_.stop_label_offset,
+                                    settings_.stop_label_font_size, db_.GetStopName(stop_id)));
+  }
+  element_index_ = SpatialIndex(move(bounds));
+}
+
+string MapBuilder::RenderTile(const TileId &tile) const {
+  Render();
+  call_once(elements_indexed_, [this] { IndexElements(); });
+
+  const double tile_count = static_cast<double>(1u << tile.zoom);
+  const double tile_width = settings_.width / tile_count;
+  const double tile_height = settings_.height / tile_count;
+  const Svg::Point origin{tile.x * tile_width, tile.y * tile_height};
+  Svg::Writer svg({origin, tile_width, tile_height});
+
+  // ids follow the order of drawing, so the elements of a layer come out in it
+  const vector<uint32_t> element_ids = element_index_.Find({origin, {origin.x + tile_width, origin.y + tile_height}});
   for (const string &layer : settings_.layers) {
-    if (layer == "bus_lines") {
-      DrawBuses();
-    } else if (layer == "bus_labels") {
-      DrawBusLabels();
-    } else if (layer == "stop_points") {
-      DrawStops();
-    } else if (layer == "stop_labels") {
-      DrawStopLabels();
+    const ElementKind kind = GetLayerKind(layer);
+    for (size_t idx = 0; idx < element_ids.size(); ++idx) {
+      const MapElement &element = elements_[element_ids[idx]];
+      if (element.kind != kind)
+        continue;
+      switch (kind) {
+        case ElementKind::BUS_LINE: {
+          // consecutive segments of a bus make one polyline
+          size_t end = element.index + 1;
+          for (; idx + 1 < element_ids.size(); ++idx) {
+            const MapElement &next = elements_[element_ids[idx + 1]];
+            if (next.kind != kind || next.id != element.id || next.index != end)
+              break;
+            ++end;
+          }
+          DrawBusLine(svg, element.id, element.index, end + 1);
+          break;
+        }
+        case ElementKind::BUS_LABEL: {
+          DrawBusLabel(svg, element.id, db_.GetBusStopIds(element.id)[element.index], GetBusLabelColor(element.id));
+          break;
+        }
+        case ElementKind::STOP_POINT:
+          DrawStop(svg, element.id);
+          break;
+        case ElementKind::STOP_LABEL:
+          DrawStopLabel(svg, element.id);
+          break;
+      }
+    }
+  }
+  return move(svg).Finish();
+}
+
+string MapBuilder::RenderRoute(const Responses::Route &route, string_view stop_to) const {
+  Render();
+
+  // a bus item starts at the stop of the wait item before it and ends where the next one starts
+  struct Ride {
+    TransportData::BusId bus_id;
+    TransportData::StopId stop_from;
+    size_t span_count;
+    size_t begin = 0;  // index of stop_from in the stops of the bus
+  };
+  // the route is found in the same database, so an item it doesn't match is a bug
+  vector<Ride> rides;
+  optional<TransportData::StopId> current_stop;
+  for (const auto &item : route.items) {
+    if (const auto *wait_item = get_if<Responses::Route::WaitItem>(&item)) {
+      current_stop = db_.FindStopId(wait_item->stop_name);
+      if (!current_stop) {
+        throw logic_error("route waits at unknown stop " + wait_item->stop_name);
+      }
     } else {
-      throw runtime_error("unknown map layer");
+      const auto &bus_item = get<Responses::Route::BusItem>(item);
+      const auto bus_id = db_.FindBusId(bus_item.bus_name);
+      if (!bus_id) {
+        throw logic_error("route rides unknown bus " + bus_item.bus_name);
+      }
+      if (!current_stop) {
+        throw logic_error("route rides bus " + bus_item.bus_name + " before waiting at a stop");
+      }
+      rides.push_back({*bus_id, *current_stop, bus_item.span_count});
+    }
+  }
+  const auto final_stop_id = db_.FindStopId(stop_to);
+  if (!final_stop_id) {
+    throw logic_error("route ends at unknown stop " + string(stop_to));
+  }
+  const TransportData::StopId final_stop = *final_stop_id;
+  for (size_t ride_idx = 0; ride_idx < rides.size(); ++ride_idx) {
+    Ride &ride = rides[ride_idx];
+    const TransportData::StopId ride_to = ride_idx + 1 < rides.size() ? rides[ride_idx + 1].stop_from : final_stop;
+    const auto stops = db_.GetBusStopIds(ride.bus_id);
+    bool is_found = false;
+    for (size_t stop_idx = 0; stop_idx + ride.span_count < stops.size(); ++stop_idx) {
+      if (stops[stop_idx] == ride.stop_from && stops[stop_idx + ride.span_count] == ride_to) {
+        ride.begin = stop_idx;
+        is_found = true;
+        break;
+      }
+    }
+    if (!is_found) {
+      throw logic_error("bus " + string(db_.GetBusName(ride.bus_id)) + " doesn't go from "
+                        + string(db_.GetStopName(ride.stop_from)) + " to " + string(db_.GetStopName(ride_to))
+                        + " in " + to_string(ride.span_count) + " stops");
+    }
+  }
+
+  Svg::Writer svg;
+  const string_view underlayer_color = settings_.underlayer_color.color_string;
+  svg.Rectangle({0, 0}, settings_.width, settings_.height, {.fill_color = underlayer_color});
+  for (const string &layer : settings_.layers) {
+    switch (GetLayerKind(layer)) {
+      case ElementKind::BUS_LINE:
+        for (const Ride &ride : rides) {
+          DrawBusLine(svg, ride.bus_id, ride.begin, ride.begin + ride.span_count + 1);
+        }
+        break;
+      case ElementKind::BUS_LABEL:
+        for (const Ride &ride : rides) {
+          const auto stops = db_.GetBusStopIds(ride.bus_id);
+          for (const size_t stop_idx : {ride.begin, ride.begin + ride.span_count}) {
+            const TransportData::StopId stop_id = stops[stop_idx];
+            if (stop_id == stops[0] || (!db_.IsRoundtrip(ride.bus_id) && stop_id == stops[stops.size() / 2]))
+              DrawBusLabel(svg, ride.bus_id, stop_id, GetBusLabelColor(ride.bus_id));
+          }
+        }
+        break;
+      case ElementKind::STOP_POINT:
+        for (const Ride &ride : rides) {
+          const auto stops = db_.GetBusStopIds(ride.bus_id);
+          for (size_t stop_idx = ride.begin; stop_idx <= ride.begin + ride.span_count; ++stop_idx) {
+            DrawStop(svg, stops[stop_idx]);
+          }
+        }
+        break;
+      case ElementKind::STOP_LABEL:
+        for (const Ride &ride : rides) {
+          DrawStopLabel(svg, ride.stop_from);
+        }
+        if (!rides.empty())
+          DrawStopLabel(svg, final_stop);
+        break;
     }
   }
+  return move(svg).Finish();
 }
 
-void MapBuilder::DrawBuses() {
-  size_t color_id = 0;
-  for (const string &bus_name : bus_names_) {
-    Svg::Polyline polyline;
-    polyline.SetStrokeColor(settings_.color_palette[color_id++ % settings_.color_palette.size()]);
-    polyline.SetStrokeWidth(settings_.line_width);
-    polyline.SetStrokeLineCap("round").SetStrokeLineJoin("round");
-    for (const string &stop_name : db_.GetBusesData().at(bus_name).stops) {
-      polyline.AddPoint(projector_->ProjectStop(stop_name));
+void MapBuilder::DrawLayers(Svg::Writer &svg) const {
+  for (const string &layer : settings_.layers) {
+    switch (GetLayerKind(layer)) {
+      case ElementKind::BUS_LINE:
+        DrawBuses(svg);
+        break;
+      case ElementKind::BUS_LABEL:
+        DrawBusLabels(svg);
+        break;
+      case ElementKind::STOP_POINT:
+        DrawStops(svg);
+        break;
+      case ElementKind::STOP_LABEL:
+        DrawStopLabels(svg);
+        break;
     }
-    doc_.Add(move(polyline));
   }
 }
 
-void MapBuilder::DrawStops() {
-  for (const string &stop_name : stop_names_) {
-    Svg::Circle stop_circle;
-    stop_circle.SetCenter(projector_->ProjectStop(stop_name));
-    stop_circle.SetRadius(settings_.stop_radius);
-    stop_circle.SetFillColor("white");
-    doc_.Add(move(stop_circle));
+Svg::Style MapBuilder::UnderlayerStyle() const {
+  return {
+      .fill_color = settings_.underlayer_color.color_string,
+      .stroke_color = settings_.underlayer_color.color_string,
+      .stroke_width = settings_.undrlayer_width,
+      .line_cap = "round",
+      .line_join = "round",
+  };
+}
+
+void MapBuilder::DrawBuses(Svg::Writer &svg) const {
+  for (TransportData::BusId bus_id = 0; bus_id < db_.GetBusCount(); ++bus_id) {
+    DrawBusLine(svg, bus_id, 0, db_.GetBusStopIds(bus_id).size());
   }
 }
 
-void MapBuilder::DrawStopLabels() {
-  for (const string &stop_name : stop_names_) {
-    Svg::Text substrate;
-    substrate.SetPoint(projector_->ProjectStop(stop_name));
-    substrate.SetOffset(settings_.stop_label_offset);
-    substrate.SetFontSize(settings_.stop_label_font_size);
-    substrate.SetFontFamily("Verdana");
-    substrate.SetData(stop_name);
-    Svg::Text text = substrate;
+void MapBuilder::DrawStops(Svg::Writer &svg) const {
+  for (TransportData::StopId stop_id = 0; stop_id < db_.GetStopCount(); ++stop_id) {
+    DrawStop(svg, stop_id);
+  }
+}
 
-    substrate.SetFillColor(settings_.underlayer_color);
-    substrate.SetStrokeColor(settings_.underlayer_color);
-    substrate.SetStrokeWidth(settings_.undrlayer_width);
-    substrate.SetStrokeLineCap("round");
-    substrate.SetStrokeLineJoin("round");
-    text.SetFillColor("black");
-    doc_.Add(move(substrate));
-    doc_.Add(move(text));
+void MapBuilder::DrawStopLabels(Svg::Writer &svg) const {
+  for (TransportData::StopId stop_id = 0; stop_id < db_.GetStopCount(); ++stop_id) {
+    DrawStopLabel(svg, stop_id);
   }
 }
 
-void MapBuilder::DrawBusLabels() {
-  size_t color_id = 0;
-  for (const string &bus_name : bus_names_) {
-    const TransportData::Bus &bus = db_.GetBusesData().at(bus_name);
-    if (bus.stops.empty())
+void MapBuilder::DrawBusLabels(Svg::Writer &svg) const {
+  for (TransportData::BusId bus_id = 0; bus_id < db_.GetBusCount(); ++bus_id) {
+    const auto stops = db_.GetBusStopIds(bus_id);
+    if (stops.empty())
       continue;
 
-    Svg::Text first_stop_substrate;
-    const string &first_stop_name = bus.stops.front();
-    first_stop_substrate.SetPoint(projector_->ProjectStop(first_stop_name));
-    first_stop_substrate.SetOffset(settings_.bus_label_offset);
-    first_stop_substrate.SetFontSize(settings_.bus_label_font_size);
-    first_stop_substrate.SetFontFamily("Verdana");
-    first_stop_substrate.SetFontWeight("bold");
-    first_stop_substrate.SetData(bus_name);
-    Svg::Text first_stop_text = first_stop_substrate;
-
-    first_stop_substrate.SetFillColor(settings_.underlayer_color);
-    first_stop_substrate.SetStrokeColor(settings_.underlayer_color);
-    first_stop_substrate.SetStrokeWidth(settings_.undrlayer_width);
-    first_stop_substrate.SetStrokeLineCap("round");
-    first_stop_substrate.SetStrokeLineJoin("round");
-    first_stop_text.SetFillColor(settings_.color_palette[color_id++ % settings_.color_palette.size()]);
-    doc_.Add(first_stop_substrate);
-    doc_.Add(first_stop_text);
-
-    const string &last_stop_name = bus.stops[bus.stops.size() / 2];
-    if (bus.is_roundtrip || last_stop_name == first_stop_name)
+    const Svg::Color &color = GetBusLabelColor(bus_id);
+    const TransportData::StopId first_stop = stops[0];
+    DrawBusLabel(svg, bus_id, first_stop, color);
+
+    const TransportData::StopId last_stop = stops[stops.size() / 2];
+    if (db_.IsRoundtrip(bus_id) || last_stop == first_stop)
       continue;
+    DrawBusLabel(svg, bus_id, last_stop, color);
+  }
+}
 
-    Svg::Text last_stop_substrate = first_stop_substrate;
-    last_stop_substrate.SetPoint(projector_->ProjectStop(last_stop_name));
-    Svg::Text last_stop_text = first_stop_text;
-    last_stop_text.SetPoint(projector_->ProjectStop(last_stop_name));
-    doc_.Add(move(last_stop_substrate));
-    doc_.Add(move(last_stop_text));
+// Stops of the bus from begin to end, not including it
+void MapBuilder::DrawBusLine(Svg::Writer &svg, TransportData::BusId bus_id, size_t begin, size_t end) const {
+  const auto stops = db_.GetBusStopIds(bus_id);
+  svg.BeginPolyline();
+  for (size_t stop_idx = begin; stop_idx < end; ++stop_idx) {
+    svg.AddPoint(projector_->ProjectStop(stops[stop_idx]));
   }
+  svg.EndPolyline({
+      .stroke_color = settings_.color_palette[bus_id % settings_.color_palette.size()].color_string,
+      .stroke_width = settings_.line_width,
+      .line_cap = "round",
+      .line_join = "round",
+  });
+}
+
+void MapBuilder::DrawBusLabel(Svg::Writer &svg, TransportData::BusId bus_id, TransportData::StopId stop_id,
+                              const Svg::Color &color) const {
+  const Svg::Font font{
+      .size = static_cast<uint32_t>(settings_.bus_label_font_size),
+      .family = "Verdana",
+      .weight = "bold",
+  };
+  const Svg::Point point = projector_->ProjectStop(stop_id);
+  const string_view name = db_.GetBusName(bus_id);
+  svg.Text(point, settings_.bus_label_offset, font, UnderlayerStyle(), name);
+  svg.Text(point, settings_.bus_label_offset, font, {.fill_color = color.color_string}, name);
+}
+
+void MapBuilder::DrawStop(Svg::Writer &svg, TransportData::StopId stop_id) const {
+  svg.Circle(projector_->ProjectStop(stop_id), settings_.stop_radius, {.fill_color = "white"});
+}
+
+void MapBuilder::DrawStopLabel(Svg::Writer &svg, TransportData::StopId stop_id) const {
+  const Svg::Font font{.size = static_cast<uint32_t>(settings_.stop_label_font_size), .family = "Verdana"};
+  const Svg::Point point = projector_->ProjectStop(stop_id);
+  const string_view name = db_.GetStopName(stop_id);
+  svg.Text(point, settings_.stop_label_offset, font, UnderlayerStyle(), name);
+  svg.Text(point, settings_.stop_label_offset, font, {.fill_color = "black"}, name);
+}
 }
-}
\ No newline at end of file
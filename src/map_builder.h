@@ -1,18 +1,20 @@
 #pragma once
 
+#include "lru_cache.h"
 #include "map_projector.h"
+#include "responses.h"
+#include "spatial_index.h"
 #include "svg.h"
 #include "transport_data.h"
 #include "transport_database.h"
-#include <map>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_map>
 
 namespace Visualisation {
-using StopsDict = TransportData::StopsDict;
-using BusesDict = TransportData::BusesDict;
-
 struct RenderSettings {
   double width;
   double height;
@@ -31,38 +33,96 @@ struct RenderSettings {
   double undrlayer_width;
 };
 
-template <typename T>
-std::set<std::string> SortNames(const std::unordered_map<std::string, T> &map) {
-  std::set<std::string> sorted_names;
-  for (const auto &[name, _] : map) {
-    sorted_names.insert(name);
-  }
-  return sorted_names;
-}
-
 Svg::Color ParseColor(const Json::Node &color_node);
 RenderSettings ParseRenderSettings(const Json::Dict &render_settings);
-std::string EscapeSpecialCharacters(const std::string &input);
+
+void Write(std::ostream &output, const RenderSettings &settings);
+void Read(std::istream &input, RenderSettings &settings);
+
+// Tile x, y of the map cut into 2^zoom by 2^zoom equal tiles, counted from the top left one
+struct TileId {
+  uint32_t zoom;
+  uint32_t x;
+  uint32_t y;
+
+  bool operator==(const TileId &other) const {
+    return zoom == other.zoom && x == other.x && y == other.y;
+  }
+};
+
+struct TileIdHasher {
+  size_t operator()(const TileId &tile) const {
+    return (static_cast<size_t>(tile.zoom) * 0x9E3779B1u + tile.x) * 0x9E3779B1u + tile.y;
+  }
+};
 
 class MapBuilder {
  public:
   explicit MapBuilder(const TransportDatabase::Database &db, const Json::Dict &render_settings);
-  [[nodiscard]] std::string GetMap() const { return map_; }
+  // Restores settings, stop projections and the map saved by Serialize without rendering
+  MapBuilder(const TransportDatabase::Database &db, std::istream &input);
+
+  // The map is rendered once, on first use, and then shared by all callers
+  void Render() const;
+  [[nodiscard]] const std::string &GetMap() const;
+  // Only the elements intersecting the tile are rendered, in the coordinates of the whole map;
+  // recently used tiles are cached. nullptr for a tile out of the map.
+  [[nodiscard]] std::shared_ptr<const std::string> GetTile(const TileId &tile) const;
+
+  // Route drawn over the map: its bus segments, the labels of bus terminals on it, its stops and
+  // the labels of the stops where it changes buses, over a translucent underlayer covering the map.
+  // Only the overlay is rendered; clients put it over the map. Throws logic_error if the route doesn't
+  // follow the buses of the database.
+  [[nodiscard]] std::string RenderRoute(const Responses::Route &route, std::string_view stop_to) const;
+
+  void Serialize(std::ostream &output) const;
 
  private:
+  static const uint32_t MAX_TILE_ZOOM = 20;
+  static const size_t TILE_CACHE_SIZE = 256;
+
+  enum class ElementKind : uint8_t { BUS_LINE, BUS_LABEL, STOP_POINT, STOP_LABEL };
+  // segment of bus id from its stop at index to the next one, label of bus id at its stop at index,
+  // point or label of stop id
+  struct MapElement {
+    ElementKind kind;
+    uint32_t id;
+    uint32_t index;
+  };
+
   RenderSettings settings_;
-  std::unique_ptr<Projector> projector_;
   const TransportDatabase::Database &db_;
-  std::set<std::string> bus_names_;
-  std::set<std::string> stop_names_;
+  // buses with no stops have no labels and don't take a color for them
+  std::vector<size_t> bus_label_color_ids_;
+
+  mutable std::once_flag map_rendered_;
+  mutable std::unique_ptr<Projector> projector_;
+  mutable std::string map_{};
+
+  // elements of every layer in the order they are drawn, indexed by their bounds on the map
+  mutable std::once_flag elements_indexed_;
+  mutable std::vector<MapElement> elements_;
+  mutable SpatialIndex element_index_;
+  mutable LruCache<TileId, std::shared_ptr<const std::string>, TileIdHasher> tiles_{TILE_CACHE_SIZE};
+
+  static ElementKind GetLayerKind(const std::string &layer);
+  void ComputeBusLabelColors();
+  const Svg::Color &GetBusLabelColor(TransportData::BusId bus_id) const;
+  void IndexElements() const;
+  Rect GetLabelBounds(Svg::Point point, Svg::Point offset, int font_size, std::string_view text) const;
+  std::string RenderTile(const TileId &tile) const;
 
-  Svg::Document doc_{};
-  std::string map_{};
+  Svg::Style UnderlayerStyle() const;
+  void DrawLayers(Svg::Writer &svg) const;
+  void DrawBuses(Svg::Writer &svg) const;
+  void DrawBusLabels(Svg::Writer &svg) const;
+  void DrawStops(Svg::Writer &svg) const;
+  void DrawStopLabels(Svg::Writer &svg) const;
 
-  void DrawLayers();
-  void DrawBuses();
-  void DrawBusLabels();
-  void DrawStops();
-  void DrawStopLabels();
+  void DrawBusLine(Svg::Writer &svg, TransportData::BusId bus_id, size_t begin, size_t end) const;
+  void DrawBusLabel(Svg::Writer &svg, TransportData::BusId bus_id, TransportData::StopId stop_id,
+                    const Svg::Color &color) const;
+  void DrawStop(Svg::Writer &svg, TransportData::StopId stop_id) const;
+  void DrawStopLabel(Svg::Writer &svg, TransportData::StopId stop_id) const;
 };
 }
@@ -1,8 +1,10 @@
 #pragma once
 
+#include "flat_array.h"
 #include "transport_database.h"
 #include "svg.h"
 #include <limits>
+#include <map>
 #include <vector>
 #include <utility>
 
@@ -10,7 +12,7 @@ namespace Visualisation {
 class Projector {
  public:
   virtual ~Projector() = default;
-  virtual Svg::Point ProjectStop(const std::string &stop_name) const = 0;
+  virtual Svg::Point ProjectStop(TransportData::StopId stop_id) const = 0;
 };
 
 
@@ -20,7 +22,7 @@ class GeoProjector : public Projector {
   GeoProjector(const TransportDatabase::Database &db, double width,
                double height, double padding);
 
-  Svg::Point ProjectStop(const std::string &stop_name) const override;
+  Svg::Point ProjectStop(TransportData::StopId stop_id) const override;
 
  private:
   const TransportDatabase::Database &db_;
@@ -31,10 +33,25 @@ class GeoProjector : public Projector {
   double max_lat_{std::numeric_limits<double>::min()};
 };
 
+// Projection restored from a database snapshot
+class PrecomputedProjector : public Projector {
+ public:
+  ~PrecomputedProjector() override = default;
+  explicit PrecomputedProjector(std::vector<Svg::Point> stop_projection)
+    : stop_projection_(std::move(stop_projection)) {}
+
+  Svg::Point ProjectStop(TransportData::StopId stop_id) const override {
+    return stop_projection_.at(stop_id);
+  }
+
+ private:
+  std::vector<Svg::Point> stop_projection_;
+};
+
 class UniformProjector : public Projector {
 private:
   struct StopPosition {
-    std::string stop_name;
+    TransportData::StopId stop_id;
     Location::Point position;
   };
 
@@ -43,8 +60,8 @@ private:
   UniformProjector(const TransportDatabase::Database &db, double width,
                    double height, double padding);
 
-  Svg::Point ProjectStop(const std::string &stop_name) const override {
-    return stop_projection_.at(stop_name);
+  Svg::Point ProjectStop(TransportData::StopId stop_id) const override {
+    return stop_projection_.at(stop_id);
   }
 
  private:
@@ -55,18 +72,22 @@ private:
 
   std::map<Location::Point, size_t> x_stop_indexing_;
   std::map<Location::Point, size_t> y_stop_indexing_;
-  std::map<std::string, Svg::Point> stop_projection_;
-  std::unordered_set<std::string> reference_stops_;
+  std::vector<Svg::Point> stop_projection_;
+  std::vector<bool> reference_stops_;
 
   std::vector<StopPosition> ComputeUniformStopPositions(const TransportDatabase::Database &db);
-  std::pair<size_t, size_t> CoordinatesIndexing(std::vector<StopPosition> &stop_positions);
+  std::pair<size_t, size_t> CoordinatesIndexing(std::vector<StopPosition> &stop_positions,
+                                                const FlatLists<TransportData::StopId> &neighbour_stops);
 
-  std::map<std::string, Svg::Point>
+  std::vector<Svg::Point>
   CoordinatesCompression(const std::vector<StopPosition> &stop_positions, size_t x_count, size_t y_count) const ;
 
   void FindReferenceStops(const TransportDatabase::Database &db);
-  std::pair<std::map<Location::Point, size_t>, size_t> IndexAxis(const std::vector<StopPosition> &stop_positions) const;
-  bool CheckAdjacency(const std::string &current_stop, const std::set<std::string> &other_stops) const;
+  // stops next to each stop on any bus route, sorted
+  static FlatLists<TransportData::StopId> FindNeighbourStops(const TransportDatabase::Database &db);
+  std::pair<std::map<Location::Point, size_t>, size_t>
+  IndexAxis(const std::vector<StopPosition> &stop_positions,
+            const FlatLists<TransportData::StopId> &neighbour_stops) const;
 };
 
 
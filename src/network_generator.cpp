@@ -0,0 +1,344 @@
+#include "network_generator.h"
+#include "location.h"
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+namespace NetworkGenerator {
+  namespace {
+    const Location::Point CITY_CENTER{55.75, 37.62};
+    const double CITY_RADIUS = 0.25;  // degrees of latitude
+    const double PI = 3.14159265358979323846;
+
+    string GetStopName(size_t stop_idx) {
+      return "Stop " + to_string(stop_idx);
+    }
+
+    string GetBusName(size_t bus_idx) {
+      return to_string(bus_idx + 1);
+    }
+
+    // a degree of longitude is shorter than one of latitude
+    double GetLongitudeScale() {
+      return 1 / cos(Location::ConvertDegreesToRadians(CITY_CENTER.latitude));
+    }
+
+    // Stops bucketed by a grid of about two stops per cell, to walk routes between near stops
+    class StopGrid {
+     public:
+      explicit StopGrid(const vector<Location::Point> &positions)
+        : positions_(positions), longitude_scale_(GetLongitudeScale()) {
+        grid_size_ = max<size_t>(1, static_cast<size_t>(sqrt(positions.size() / 2.0)));
+        cells_.resize(grid_size_ * grid_size_);
+        for (size_t stop_idx = 0; stop_idx < positions.size(); ++stop_idx) {
+          const auto [row, column] = GetCell(positions[stop_idx]);
+          cells_[row * grid_size_ + column].push_back(stop_idx);
+        }
+      }
+
+      // Stops in the cells around the one of the stop, at most radius cells away
+      void FindNearStops(size_t stop_idx, size_t radius, vector<size_t> &near_stops) const {
+        near_stops.clear();
+        const auto [row, column] = GetCell(positions_[stop_idx]);
+        for (size_t near_row = row > radius ? row - radius : 0; near_row <= min(row + radius, grid_size_ - 1); ++near_row) {
+          for (size_t near_column = column > radius ? column - radius : 0;
+               near_column <= min(column + radius, grid_size_ - 1); ++near_column) {
+            const auto &cell = cells_[near_row * grid_size_ + near_column];
+            near_stops.insert(near_stops.end(), cell.begin(), cell.end());
+          }
+        }
+      }
+
+     private:
+      pair<size_t, size_t> GetCell(Location::Point position) const {
+        const auto get_idx = [this](double offset) {
+          return min(grid_size_ - 1, static_cast<size_t>(max(0.0, (offset + CITY_RADIUS) / (2 * CITY_RADIUS) * grid_size_)));
+        };
+        return {get_idx(position.latitude - CITY_CENTER.latitude),
+                get_idx((position.longitude - CITY_CENTER.longitude) / longitude_scale_)};
+      }
+
+      const vector<Location::Point> &positions_;
+      double longitude_scale_;
+      size_t grid_size_;
+      vector<vector<size_t>> cells_;
+    };
+
+    double RoundCoordinate(double degrees) {
+      return round(degrees * 1e6) / 1e6;
+    }
+
+    vector<Location::Point> GenerateStopPositions(size_t stop_count, mt19937_64 &generator) {
+      // stops are denser to the center of a round city, which spans more degrees of longitude than of latitude
+      uniform_real_distribution<double> unit(0., 1.);
+      const double longitude_scale = GetLongitudeScale();
+      vector<Location::Point> positions;
+      positions.reserve(stop_count);
+      for (size_t stop_idx = 0; stop_idx < stop_count; ++stop_idx) {
+        const double distance = CITY_RADIUS * pow(unit(generator), 0.75);
+        const double angle = 2 * PI * unit(generator);
+        positions.push_back({
+            RoundCoordinate(CITY_CENTER.latitude + distance * sin(angle)),
+            RoundCoordinate(CITY_CENTER.longitude + distance * cos(angle) * longitude_scale),
+        });
+      }
+      return positions;
+    }
+
+    // Stops are picked from the nearest cells first and from farther ones only if all stops around were visited
+    class RouteWalker {
+     public:
+      RouteWalker(const Params &params, const StopGrid &grid, mt19937_64 &generator)
+        : params_(params), grid_(grid), generator_(generator), served_(params.stop_count, false) {}
+
+      vector<size_t> GenerateRoute() {
+        const size_t length = uniform_int_distribution<size_t>(params_.min_route_length, params_.max_route_length)(generator_);
+        vector<size_t> route{PickFirstStop()};
+        unordered_set<size_t> visited(route.begin(), route.end());
+        vector<size_t> near_stops;
+        while (route.size() < length) {
+          optional<size_t> next_stop;
+          for (size_t radius = 1; radius <= 3 && !next_stop; ++radius) {
+            grid_.FindNearStops(route.back(), radius, near_stops);
+            near_stops.erase(remove_if(near_stops.begin(), near_stops.end(), [&visited](size_t stop_idx) {
+              return visited.count(stop_idx) > 0;
+            }), near_stops.end());
+            next_stop = PickStop(near_stops);
+          }
+          if (!next_stop)
+            break;
+          route.push_back(*next_stop);
+          visited.insert(*next_stop);
+        }
+        for (const size_t stop_idx : route) {
+          if (!served_[stop_idx]) {
+            served_[stop_idx] = true;
+            served_stops_.push_back(stop_idx);
+          }
+        }
+        return route;
+      }
+
+     private:
+      size_t PickFirstStop() {
+        if (!served_stops_.empty() && IsTransfer())
+          return served_stops_[uniform_int_distribution<size_t>(0, served_stops_.size() - 1)(generator_)];
+        return uniform_int_distribution<size_t>(0, params_.stop_count - 1)(generator_);
+      }
+
+      optional<size_t> PickStop(vector<size_t> &stops) {
+        if (stops.empty())
+          return nullopt;
+        if (IsTransfer()) {
+          const auto served_end = partition(stops.begin(), stops.end(), [this](size_t stop_idx) {
+            return served_[stop_idx];
+          });
+          if (served_end != stops.begin())
+            stops.erase(served_end, stops.end());
+        }
+        return stops[uniform_int_distribution<size_t>(0, stops.size() - 1)(generator_)];
+      }
+
+      bool IsTransfer() {
+        return bernoulli_distribution(params_.transfer_density)(generator_);
+      }
+
+      const Params &params_;
+      const StopGrid &grid_;
+      mt19937_64 &generator_;
+      vector<bool> served_;
+      vector<size_t> served_stops_;
+    };
+
+    int ComputeRoadDistance(Location::Point from, Location::Point to, mt19937_64 &generator) {
+      // roads are longer than straight lines
+      const double road_factor = uniform_real_distribution<double>(1.1, 1.6)(generator);
+      return max(1, static_cast<int>(Location::Distance(from, to) * road_factor));
+    }
+
+    void CheckParams(const Params &params) {
+      if (params.min_route_length == 0 || params.min_route_length > params.max_route_length) {
+        throw invalid_argument("route lengths must be positive and the minimal one not greater than the maximal one");
+      }
+      for (const double ratio : {params.roundtrip_ratio, params.transfer_density, params.both_directions_ratio}) {
+        if (ratio < 0 || ratio > 1) {
+          throw invalid_argument("ratios must be from 0 to 1");
+        }
+      }
+      const RequestMix &mix = params.request_mix;
+      if (min({mix.stop, mix.bus, mix.route, mix.map}) < 0 || mix.stop + mix.bus + mix.route + mix.map <= 0) {
+        throw invalid_argument("request frequencies must be non negative and not all zero");
+      }
+    }
+
+    Json::Node MakeArray(const vector<string> &items) {
+      Json::Array result;
+      result.reserve(items.size());
+      for (const string &item : items) {
+        result.emplace_back(item);
+      }
+      return result;
+    }
+
+    Json::Dict MakeRoutingSettings(const Params &params) {
+      return {
+          {"bus_wait_time", Json::Node(6)},
+          {"bus_velocity", Json::Node(40)},
+          {"routing_algorithm", Json::Node(params.routing_algorithm)},
+          {"graph_model", Json::Node(params.graph_model)},
+      };
+    }
+
+    Json::Dict MakeRenderSettings() {
+      return {
+          {"width", Json::Node(1500)},
+          {"height", Json::Node(950)},
+          {"padding", Json::Node(50)},
+          {"stop_radius", Json::Node(3)},
+          {"line_width", Json::Node(10)},
+          {"stop_label_font_size", Json::Node(13)},
+          {"stop_label_offset", Json::Node(Json::Array{Json::Node(7), Json::Node(-3)})},
+          {"bus_label_font_size", Json::Node(18)},
+          {"bus_label_offset", Json::Node(Json::Array{Json::Node(7), Json::Node(15)})},
+          {"underlayer_color", Json::Node(Json::Array{Json::Node(255), Json::Node(255), Json::Node(255), Json::Node(0.85)})},
+          {"underlayer_width", Json::Node(3)},
+          {"color_palette", MakeArray({"green", "red", "blue", "brown", "orange", "purple"})},
+          {"layers", MakeArray({"bus_lines", "bus_labels", "stop_points", "stop_labels"})},
+      };
+    }
+  }
+
+  const char *const PARAMS_USAGE =
+      "    [--stops N] [--buses N] [--min-route N] [--max-route N] [--roundtrip-ratio R]\n"
+      "    [--transfer-density R] [--both-directions-ratio R] [--requests N]\n"
+      "    [--stop-requests W] [--bus-requests W] [--route-requests W] [--map-requests W]\n"
+      "    [--algorithm floyd_warshall|dijkstra|contraction_hierarchies] [--graph-model stop_pairs|bus_chains]\n"
+      "    [--seed N]\n";
+
+  bool ParseParam(string_view option, const string &value, Params &params) {
+    if (option == "--stops") {
+      params.stop_count = stoul(value);
+    } else if (option == "--buses") {
+      params.bus_count = stoul(value);
+    } else if (option == "--min-route") {
+      params.min_route_length = stoul(value);
+    } else if (option == "--max-route") {
+      params.max_route_length = stoul(value);
+    } else if (option == "--roundtrip-ratio") {
+      params.roundtrip_ratio = stod(value);
+    } else if (option == "--transfer-density") {
+      params.transfer_density = stod(value);
+    } else if (option == "--both-directions-ratio") {
+      params.both_directions_ratio = stod(value);
+    } else if (option == "--requests") {
+      params.request_count = stoul(value);
+    } else if (option == "--stop-requests") {
+      params.request_mix.stop = stod(value);
+    } else if (option == "--bus-requests") {
+      params.request_mix.bus = stod(value);
+    } else if (option == "--route-requests") {
+      params.request_mix.route = stod(value);
+    } else if (option == "--map-requests") {
+      params.request_mix.map = stod(value);
+    } else if (option == "--algorithm") {
+      params.routing_algorithm = value;
+    } else if (option == "--graph-model") {
+      params.graph_model = value;
+    } else if (option == "--seed") {
+      params.seed = stoull(value);
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  Json::Dict GenerateInput(const Params &params) {
+    CheckParams(params);
+    mt19937_64 generator(params.seed);
+    const vector<Location::Point> positions = GenerateStopPositions(params.stop_count, generator);
+    const StopGrid grid(positions);
+
+    Json::Array base_requests;
+    // a distance is given from the stop a route goes from, and sometimes from the next one too;
+    // the first one given for a pair is kept
+    vector<Json::Dict> road_distances(params.stop_count);
+    RouteWalker walker(params, grid, generator);
+    for (size_t bus_idx = 0; bus_idx < params.bus_count && params.stop_count > 0; ++bus_idx) {
+      vector<size_t> route = walker.GenerateRoute();
+      const bool is_roundtrip = route.size() > 2 && bernoulli_distribution(params.roundtrip_ratio)(generator);
+      if (is_roundtrip)
+        route.push_back(route.front());
+      for (size_t idx = 1; idx < route.size(); ++idx) {
+        const size_t from = route[idx - 1];
+        const size_t to = route[idx];
+        road_distances[from].emplace(GetStopName(to), Json::Node(ComputeRoadDistance(positions[from], positions[to], generator)));
+        if (bernoulli_distribution(params.both_directions_ratio)(generator)) {
+          road_distances[to].emplace(GetStopName(from), Json::Node(ComputeRoadDistance(positions[to], positions[from], generator)));
+        }
+      }
+
+      vector<string> stop_names;
+      for (const size_t stop_idx : route) {
+        stop_names.push_back(GetStopName(stop_idx));
+      }
+      base_requests.emplace_back(Json::Dict{
+          {"type", Json::Node(string("Bus"))},
+          {"name", Json::Node(GetBusName(bus_idx))},
+          {"stops", MakeArray(stop_names)},
+          {"is_roundtrip", Json::Node(is_roundtrip)},
+      });
+    }
+    for (size_t stop_idx = 0; stop_idx < params.stop_count; ++stop_idx) {
+      base_requests.emplace_back(Json::Dict{
+          {"type", Json::Node(string("Stop"))},
+          {"name", Json::Node(GetStopName(stop_idx))},
+          {"latitude", Json::Node(positions[stop_idx].latitude)},
+          {"longitude", Json::Node(positions[stop_idx].longitude)},
+          {"road_distances", Json::Node(move(road_distances[stop_idx]))},
+      });
+    }
+
+    Json::Array stat_requests;
+    const RequestMix &mix = params.request_mix;
+    discrete_distribution<int> request_type({mix.stop, mix.bus, mix.route, mix.map});
+    uniform_int_distribution<size_t> random_stop(0, max<size_t>(params.stop_count, 1) - 1);
+    uniform_int_distribution<size_t> random_bus(0, max<size_t>(params.bus_count, 1) - 1);
+    for (size_t request_idx = 0; request_idx < params.request_count && params.stop_count > 0; ++request_idx) {
+      Json::Dict request{{"id", Json::Node(static_cast<int>(request_idx + 1))}};
+      switch (request_type(generator)) {
+        case 0:
+          request["type"] = Json::Node(string("Stop"));
+          request["name"] = Json::Node(GetStopName(random_stop(generator)));
+          break;
+        case 1:
+          request["type"] = Json::Node(string("Bus"));
+          request["name"] = Json::Node(GetBusName(random_bus(generator)));
+          break;
+        case 2:
+          request["type"] = Json::Node(string("Route"));
+          request["from"] = Json::Node(GetStopName(random_stop(generator)));
+          request["to"] = Json::Node(GetStopName(random_stop(generator)));
+          break;
+        case 3:
+          request["type"] = Json::Node(string("Map"));
+          break;
+      }
+      stat_requests.emplace_back(move(request));
+    }
+
+    return {
+        {"routing_settings", Json::Node(MakeRoutingSettings(params))},
+        {"render_settings", Json::Node(MakeRenderSettings())},
+        {"serialization_settings", Json::Node(Json::Dict{{"file", Json::Node(string("transport_catalog.db"))}})},
+        {"base_requests", Json::Node(move(base_requests))},
+        {"stat_requests", Json::Node(move(stat_requests))},
+    };
+  }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "json.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Synthetic networks for load testing: stops scattered over a city, bus routes walking between
+// nearby stops and stat requests to them. The same parameters give the same input with the same
+// standard library.
+namespace NetworkGenerator {
+  // Relative frequencies of stat request types
+  struct RequestMix {
+    double stop = 3;
+    double bus = 3;
+    double route = 4;
+    double map = 0;
+  };
+
+  struct Params {
+    size_t stop_count = 1000;
+    size_t bus_count = 100;
+    // stops of a route as given, without the way back of a non roundtrip one
+    size_t min_route_length = 5;
+    size_t max_route_length = 30;
+    double roundtrip_ratio = 0.5;
+    // chance that a route starts at or goes on to a stop other buses already serve, when there is one near
+    double transfer_density = 0.3;
+    // share of road segments with distances given for both directions; the others are given for one
+    // direction only and serve the other one too
+    double both_directions_ratio = 0.2;
+    size_t request_count = 1000;
+    RequestMix request_mix;
+    std::string routing_algorithm = "dijkstra";
+    std::string graph_model = "stop_pairs";
+    uint64_t seed = 1;
+  };
+
+  // Sets the parameter of a command line option like --stops; false if the option is not a parameter
+  bool ParseParam(std::string_view option, const std::string &value, Params &params);
+  // Description of the options ParseParam takes
+  extern const char *const PARAMS_USAGE;
+
+  // Complete input: routing, render and serialization settings, base_requests and stat_requests
+  Json::Dict GenerateInput(const Params &params);
+}
@@ -0,0 +1,45 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace Parallel {
+  void RunInChunks(size_t item_count, size_t chunk_size, size_t thread_count,
+                   const function<void(size_t, size_t)> &process_chunk) {
+    const size_t chunk_count = (item_count + chunk_size - 1) / chunk_size;
+    atomic<size_t> next_chunk = 0;
+    mutex error_mutex;
+    exception_ptr error;
+    auto work = [&] {
+      for (size_t chunk = next_chunk++; chunk < chunk_count; chunk = next_chunk++) {
+        try {
+          process_chunk(chunk * chunk_size, min(item_count, (chunk + 1) * chunk_size));
+        } catch (...) {
+          lock_guard lock(error_mutex);
+          if (!error) {
+            error = current_exception();
+          }
+          next_chunk = chunk_count;
+        }
+      }
+    };
+
+    vector<thread> workers;
+    for (size_t i = 1; i < min(thread_count, chunk_count); ++i) {
+      workers.emplace_back(work);
+    }
+    work();
+    for (thread &worker : workers) {
+      worker.join();
+    }
+    if (error) {
+      rethrow_exception(error);
+    }
+  }
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace Parallel {
+  // Calls process_chunk(begin, end) for chunks of [0, item_count) on thread_count threads including the calling one;
+  // idle threads take the next unprocessed chunk. The first exception thrown stops the work and is rethrown.
+  void RunInChunks(size_t item_count, size_t chunk_size, size_t thread_count,
+                   const std::function<void(size_t, size_t)> &process_chunk);
+}
@@ -0,0 +1,210 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+
+using namespace std;
+
+namespace Profiler {
+  atomic<bool> Detail::enabled{false};
+
+  namespace {
+    struct Phase {
+      uint64_t count = 0;
+      Clock::duration total{0};
+    };
+
+    // Latencies in nanoseconds counted by buckets: the first ones hold 0..3, then every power of two
+    // is split into SUB_BUCKETS equal buckets
+    class LatencyHistogram {
+     public:
+      void Add(uint64_t latency) {
+        ++counts_[GetBucket(latency)];
+        ++count_;
+        total_ += latency;
+        max_ = std::max(max_, latency);
+      }
+
+      uint64_t GetCount() const { return count_; }
+      double GetMean() const { return count_ == 0 ? 0 : static_cast<double>(total_) / count_; }
+      uint64_t GetMax() const { return max_; }
+
+      uint64_t GetPercentile(double share) const {
+        const auto rank = static_cast<uint64_t>(share * count_);
+        uint64_t counted = 0;
+        for (size_t bucket = 0; bucket < counts_.size(); ++bucket) {
+          counted += counts_[bucket];
+          if (counted > rank) {
+            return min(GetBucketEnd(bucket), max_);
+          }
+        }
+        return max_;
+      }
+
+     private:
+      static const size_t SUB_BUCKETS = 4;
+      static const int SUB_BUCKET_BITS = 2;
+
+      static size_t GetBucket(uint64_t latency) {
+        if (latency < SUB_BUCKETS) {
+          return latency;
+        }
+        int exponent = SUB_BUCKET_BITS;
+        while (exponent < 63 && latency >> (exponent + 1)) {
+          ++exponent;
+        }
+        return exponent * SUB_BUCKETS + ((latency >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+      }
+
+      // the largest latency of the bucket
+      static uint64_t GetBucketEnd(size_t bucket) {
+        if (bucket < SUB_BUCKETS) {
+          return bucket;
+        }
+        const int shift = static_cast<int>(bucket / SUB_BUCKETS) - SUB_BUCKET_BITS;
+        const uint64_t begin = (SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+        const uint64_t width = uint64_t{1} << shift;
+        return begin > numeric_limits<uint64_t>::max() - width ? numeric_limits<uint64_t>::max() : begin + width - 1;
+      }
+
+      array<uint64_t, 64 * SUB_BUCKETS> counts_{};
+      uint64_t count_ = 0;
+      uint64_t total_ = 0;
+      uint64_t max_ = 0;
+    };
+
+    struct Records {
+      mutex lock;
+      map<string, Phase, less<>> phases;
+      map<string, uint64_t, less<>> counters;
+      map<string, LatencyHistogram, less<>> latencies;
+    };
+
+    Records &GetRecords() {
+      static Records records;
+      return records;
+    }
+
+    template <typename Value>
+    Value &GetRecord(map<string, Value, less<>> &records, string_view name) {
+      if (auto it = records.find(name); it != records.end()) {
+        return it->second;
+      }
+      return records.emplace(string(name), Value{}).first->second;
+    }
+
+    void WriteCount(Json::Handler &output, uint64_t value) {
+      if (value <= static_cast<uint64_t>(numeric_limits<int>::max())) {
+        output.Int(static_cast<int>(value));
+      } else {
+        output.Double(static_cast<double>(value));
+      }
+    }
+
+    double ToMilliseconds(Clock::duration time) {
+      return chrono::duration<double, milli>(time).count();
+    }
+
+    double ToMicroseconds(double nanoseconds) {
+      return nanoseconds / 1000;
+    }
+  }
+
+  void Enable() {
+    Detail::enabled.store(true, memory_order_relaxed);
+  }
+
+  void Disable() {
+    Detail::enabled.store(false, memory_order_relaxed);
+  }
+
+  void Reset() {
+    Records &records = GetRecords();
+    lock_guard guard(records.lock);
+    records.phases.clear();
+    records.counters.clear();
+    records.latencies.clear();
+  }
+
+  void AddPhaseTime(string_view phase, Clock::duration time) {
+    if (!IsEnabled()) {
+      return;
+    }
+    Records &records = GetRecords();
+    lock_guard guard(records.lock);
+    Phase &record = GetRecord(records.phases, phase);
+    ++record.count;
+    record.total += time;
+  }
+
+  void AddCount(string_view counter, uint64_t value) {
+    if (!IsEnabled()) {
+      return;
+    }
+    Records &records = GetRecords();
+    lock_guard guard(records.lock);
+    GetRecord(records.counters, counter) += value;
+  }
+
+  void AddLatency(string_view histogram, Clock::duration latency) {
+    if (!IsEnabled()) {
+      return;
+    }
+    Records &records = GetRecords();
+    lock_guard guard(records.lock);
+    const auto nanoseconds = chrono::duration_cast<chrono::nanoseconds>(latency).count();
+    GetRecord(records.latencies, histogram).Add(static_cast<uint64_t>(max<int64_t>(nanoseconds, 0)));
+  }
+
+  void WriteReport(Json::Handler &output) {
+    Records &records = GetRecords();
+    lock_guard guard(records.lock);
+    output.StartDict();
+
+    output.Key("phases");
+    output.StartDict();
+    for (const auto &[name, phase] : records.phases) {
+      output.Key(name);
+      output.StartDict();
+      output.Key("count");
+      WriteCount(output, phase.count);
+      output.Key("total_ms");
+      output.Double(ToMilliseconds(phase.total));
+      output.EndDict();
+    }
+    output.EndDict();
+
+    output.Key("counters");
+    output.StartDict();
+    for (const auto &[name, value] : records.counters) {
+      output.Key(name);
+      WriteCount(output, value);
+    }
+    output.EndDict();
+
+    output.Key("latencies");
+    output.StartDict();
+    for (const auto &[name, histogram] : records.latencies) {
+      output.Key(name);
+      output.StartDict();
+      output.Key("count");
+      WriteCount(output, histogram.GetCount());
+      output.Key("mean_us");
+      output.Double(ToMicroseconds(histogram.GetMean()));
+      for (const auto &[key, share] : {pair{"p50_us", 0.5}, pair{"p90_us", 0.9}, pair{"p99_us", 0.99}}) {
+        output.Key(key);
+        output.Double(ToMicroseconds(static_cast<double>(histogram.GetPercentile(share))));
+      }
+      output.Key("max_us");
+      output.Double(ToMicroseconds(static_cast<double>(histogram.GetMax())));
+      output.EndDict();
+    }
+    output.EndDict();
+
+    output.EndDict();
+  }
+}
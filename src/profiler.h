@@ -0,0 +1,58 @@
+#pragma once
+
+#include "json.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// Times of the phases of a run, counters and latency histograms. Nothing is recorded unless enabled,
+// so a disabled probe costs a relaxed atomic load. Recording is safe from several threads.
+namespace Profiler {
+  using Clock = std::chrono::steady_clock;
+
+  namespace Detail {
+    extern std::atomic<bool> enabled;
+  }
+
+  inline bool IsEnabled() {
+    return Detail::enabled.load(std::memory_order_relaxed);
+  }
+  void Enable();
+  void Disable();
+  // Drops everything recorded so far
+  void Reset();
+
+  // Times of a phase run several times are summed up
+  void AddPhaseTime(std::string_view phase, Clock::duration time);
+  void AddCount(std::string_view counter, uint64_t value);
+  void AddLatency(std::string_view histogram, Clock::duration latency);
+
+  // Adds the time spent in its scope to the phase
+  class ScopedTimer {
+   public:
+    explicit ScopedTimer(std::string_view phase) : phase_(phase) {
+      if (IsEnabled()) {
+        start_ = Clock::now();
+      }
+    }
+    ~ScopedTimer() {
+      if (start_) {
+        AddPhaseTime(phase_, Clock::now() - *start_);
+      }
+    }
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+   private:
+    std::string_view phase_;
+    std::optional<Clock::time_point> start_;
+  };
+
+  // {"phases": {name: {"count", "total_ms"}}, "counters": {name: value},
+  //  "latencies": {name: {"count", "mean_us", "p50_us", "p90_us", "p99_us", "max_us"}}};
+  // percentiles are upper bounds of histogram buckets, which are a quarter of a power of two wide
+  void WriteReport(Json::Handler &output);
+}
@@ -4,10 +4,8 @@
 
 #include <algorithm>
 #include <cassert>
-#include <cstdint>
 #include <iterator>
 #include <optional>
-#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -15,55 +13,67 @@ namespace Graph {
 
   template <typename Weight>
   class Router {
-  private:
-    using Graph = DirectedWeightedGraph<Weight>;
+  protected:
+    using Graph = CompressedDirectedWeightedGraph<Weight>;
 
   public:
-    Router(const Graph& graph);
+    explicit Router(const Graph& graph) : graph_(graph) {}
+    virtual ~Router() = default;
 
-    using RouteId = uint64_t;
+    using ExpandedRoute = std::vector<EdgeId>;
 
-    struct RouteInfo {
-      RouteId id;
-      Weight weight;
-      size_t edge_count;
-    };
+    // Returns the route weight and replaces the contents of edges with the route edges.
+    // Reentrant. Query buffers are kept by the router, so once they have grown for the concurrent queries
+    // nothing is allocated besides the growth of edges, and callers should reuse it.
+    virtual std::optional<Weight> BuildRoute(VertexId from, VertexId to, ExpandedRoute& edges) const = 0;
 
-    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
-    EdgeId GetRouteEdge(RouteId route_id, size_t edge_idx) const;
-    void ReleaseRoute(RouteId route_id);
+    // Saves the preprocessed state; routers restore it with a constructor taking the graph and the stream
+    virtual void Serialize(std::ostream& output) const = 0;
 
-  private:
+  protected:
     const Graph& graph_;
+  };
+
 
+  // Precomputes all-pairs shortest paths: O(V^3) time and O(V^2) memory, O(1) queries.
+  // Routes are kept in one row-major table, which a deserialized router may view in a mapped snapshot.
+  template <typename Weight>
+  class FloydWarshallRouter : public Router<Weight> {
+  private:
+    using typename Router<Weight>::Graph;
+    using typename Router<Weight>::ExpandedRoute;
+
+  public:
+    explicit FloydWarshallRouter(const Graph& graph);
+    FloydWarshallRouter(const Graph& graph, std::istream& input);
+
+    std::optional<Weight> BuildRoute(VertexId from, VertexId to, ExpandedRoute& edges) const override;
+    void Serialize(std::ostream& output) const override;
+
+  private:
     struct RouteInternalData {
       Weight weight;
       std::optional<EdgeId> prev_edge;
     };
-    using RoutesInternalData = std::vector<std::vector<std::optional<RouteInternalData>>>;
-
-    using ExpandedRoute = std::vector<EdgeId>;
-    mutable RouteId next_route_id_ = 0;
-    mutable std::unordered_map<RouteId, ExpandedRoute> expanded_routes_cache_;
+    using RoutesInternalData = std::vector<std::optional<RouteInternalData>>;
 
-    void InitializeRoutesInternalData(const Graph& graph) {
+    static void InitializeRoutesInternalData(const Graph& graph, RoutesInternalData& routes_internal_data) {
       const size_t vertex_count = graph.GetVertexCount();
       for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
-        routes_internal_data_[vertex][vertex] = RouteInternalData{0, std::nullopt};
+        routes_internal_data[vertex * vertex_count + vertex] = RouteInternalData{0, std::nullopt};
         for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
-          const auto& edge = graph.GetEdge(edge_id);
-          assert(edge.weight >= 0);
-          auto& route_internal_data = routes_internal_data_[vertex][edge.to];
-          if (!route_internal_data || route_internal_data->weight > edge.weight) {
-            route_internal_data = RouteInternalData{edge.weight, edge_id};
+          const Weight edge_weight = graph.GetEdgeWeight(edge_id);
+          assert(edge_weight >= 0);
+          auto& route_internal_data = routes_internal_data[vertex * vertex_count + graph.GetEdgeTarget(edge_id)];
+          if (!route_internal_data || route_internal_data->weight > edge_weight) {
+            route_internal_data = RouteInternalData{edge_weight, edge_id};
           }
         }
       }
     }
 
-    void RelaxRoute(VertexId vertex_from, VertexId vertex_to,
-                    const RouteInternalData& route_from, const RouteInternalData& route_to) {
-      auto& route_relaxing = routes_internal_data_[vertex_from][vertex_to];
+    static void RelaxRoute(std::optional<RouteInternalData>& route_relaxing,
+                           const RouteInternalData& route_from, const RouteInternalData& route_to) {
       const Weight candidate_weight = route_from.weight + route_to.weight;
       if (!route_relaxing || candidate_weight < route_relaxing->weight) {
         route_relaxing = {
@@ -75,64 +85,68 @@ namespace Graph {
       }
     }
 
-    void RelaxRoutesInternalDataThroughVertex(size_t vertex_count, VertexId vertex_through) {
+    static void RelaxRoutesInternalDataThroughVertex(size_t vertex_count, VertexId vertex_through,
+                                                     RoutesInternalData& routes_internal_data) {
       for (VertexId vertex_from = 0; vertex_from < vertex_count; ++vertex_from) {
-        if (const auto& route_from = routes_internal_data_[vertex_from][vertex_through]) {
+        if (const auto& route_from = routes_internal_data[vertex_from * vertex_count + vertex_through]) {
           for (VertexId vertex_to = 0; vertex_to < vertex_count; ++vertex_to) {
-            if (const auto& route_to = routes_internal_data_[vertex_through][vertex_to]) {
-              RelaxRoute(vertex_from, vertex_to, *route_from, *route_to);
+            if (const auto& route_to = routes_internal_data[vertex_through * vertex_count + vertex_to]) {
+              RelaxRoute(routes_internal_data[vertex_from * vertex_count + vertex_to], *route_from, *route_to);
             }
           }
         }
       }
     }
 
-    RoutesInternalData routes_internal_data_;
+    const std::optional<RouteInternalData>& GetRouteInternalData(VertexId from, VertexId to) const {
+      return routes_internal_data_[from * this->graph_.GetVertexCount() + to];
+    }
+
+    FlatArray<std::optional<RouteInternalData>> routes_internal_data_;
   };
 
 
   template <typename Weight>
-  Router<Weight>::Router(const Graph& graph)
-      : graph_(graph),
-        routes_internal_data_(graph.GetVertexCount(), std::vector<std::optional<RouteInternalData>>(graph.GetVertexCount()))
+  FloydWarshallRouter<Weight>::FloydWarshallRouter(const Graph& graph)
+      : Router<Weight>(graph)
   {
-    InitializeRoutesInternalData(graph);
-
     const size_t vertex_count = graph.GetVertexCount();
+    RoutesInternalData routes_internal_data(vertex_count * vertex_count);
+    InitializeRoutesInternalData(graph, routes_internal_data);
+
     for (VertexId vertex_through = 0; vertex_through < vertex_count; ++vertex_through) {
-      RelaxRoutesInternalDataThroughVertex(vertex_count, vertex_through);
+      RelaxRoutesInternalDataThroughVertex(vertex_count, vertex_through, routes_internal_data);
     }
+    routes_internal_data_ = std::move(routes_internal_data);
+  }
+
+  template <typename Weight>
+  FloydWarshallRouter<Weight>::FloydWarshallRouter(const Graph& graph, std::istream& input)
+      : Router<Weight>(graph)
+  {
+    Serialization::Read(input, routes_internal_data_);
+  }
+
+  template <typename Weight>
+  void FloydWarshallRouter<Weight>::Serialize(std::ostream& output) const {
+    Serialization::Write(output, routes_internal_data_);
   }
 
   template <typename Weight>
-  std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(VertexId from, VertexId to) const {
-    const auto& route_internal_data = routes_internal_data_[from][to];
+  std::optional<Weight> FloydWarshallRouter<Weight>::BuildRoute(VertexId from, VertexId to, ExpandedRoute& edges) const {
+    edges.clear();
+    const auto& route_internal_data = GetRouteInternalData(from, to);
     if (!route_internal_data) {
       return std::nullopt;
     }
-    const Weight weight = route_internal_data->weight;
-    std::vector<EdgeId> edges;
     for (std::optional<EdgeId> edge_id = route_internal_data->prev_edge;
          edge_id;
-         edge_id = routes_internal_data_[from][graph_.GetEdge(*edge_id).from]->prev_edge) {
+         edge_id = GetRouteInternalData(from, this->graph_.GetEdge(*edge_id).from)->prev_edge) {
       edges.push_back(*edge_id);
     }
     std::reverse(std::begin(edges), std::end(edges));
 
-    const RouteId route_id = next_route_id_++;
-    const size_t route_edge_count = edges.size();
-    expanded_routes_cache_[route_id] = std::move(edges);
-    return RouteInfo{route_id, weight, route_edge_count};
-  }
-
-  template <typename Weight>
-  EdgeId Router<Weight>::GetRouteEdge(RouteId route_id, size_t edge_idx) const {
-    return expanded_routes_cache_.at(route_id)[edge_idx];
-  }
-
-  template <typename Weight>
-  void Router<Weight>::ReleaseRoute(RouteId route_id) {
-    expanded_routes_cache_.erase(route_id);
+    return route_internal_data->weight;
   }
 
 }
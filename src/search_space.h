@@ -0,0 +1,76 @@
+#pragma once
+
+#include "graph.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  // Per-vertex search data which is reset in time proportional to the number of visited vertices
+  template <typename VertexData>
+  class SearchSpace {
+  public:
+    explicit SearchSpace(size_t vertex_count = 0) : vertices_data_(vertex_count) {}
+
+    const std::optional<VertexData>& operator[](VertexId vertex) const { return vertices_data_[vertex]; }
+    void Update(VertexId vertex, VertexData data) {
+      if (!vertices_data_[vertex]) {
+        visited_vertices_.push_back(vertex);
+      }
+      vertices_data_[vertex] = data;
+    }
+    void Reset() {
+      for (const VertexId vertex : visited_vertices_) {
+        vertices_data_[vertex] = std::nullopt;
+      }
+      visited_vertices_.clear();
+    }
+
+  private:
+    std::vector<std::optional<VertexData>> vertices_data_;
+    std::vector<VertexId> visited_vertices_;
+  };
+
+  // Priority queue of vertices by weight, the lightest first, which keeps its buffer when cleared
+  template <typename Weight>
+  class SearchQueue : public std::priority_queue<std::pair<Weight, VertexId>, std::vector<std::pair<Weight, VertexId>>,
+                                                 std::greater<>> {
+  public:
+    void clear() { this->c.clear(); }
+  };
+
+  // Query state reused by queries of a router; concurrent queries take different ones.
+  // Spaces are constructed from the vertex count and cleared by their Reset().
+  template <typename Spaces>
+  class QuerySpacesPool {
+  public:
+    std::unique_ptr<Spaces> Acquire(size_t vertex_count) {
+      {
+        std::lock_guard lock(mutex_);
+        if (!pool_.empty()) {
+          auto spaces = std::move(pool_.back());
+          pool_.pop_back();
+          return spaces;
+        }
+      }
+      return std::make_unique<Spaces>(vertex_count);
+    }
+
+    void Release(std::unique_ptr<Spaces> spaces) {
+      spaces->Reset();
+      std::lock_guard lock(mutex_);
+      pool_.push_back(std::move(spaces));
+    }
+
+  private:
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Spaces>> pool_;
+  };
+
+}
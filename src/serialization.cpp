@@ -0,0 +1,129 @@
+#include "serialization.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace Serialization {
+
+void WriteHeader(ostream &output) {
+  Write(output, SNAPSHOT_MAGIC);
+  Write(output, SNAPSHOT_VERSION);
+}
+
+void CheckHeader(istream &input) {
+  if (Read<uint32_t>(input) != SNAPSHOT_MAGIC) {
+    throw runtime_error("not a database snapshot");
+  }
+  if (Read<uint32_t>(input) != SNAPSHOT_VERSION) {
+    throw runtime_error("unsupported database snapshot version");
+  }
+}
+
+void WriteBytes(ostream &output, const void *data, size_t size) {
+  output.write(static_cast<const char *>(data), static_cast<streamsize>(size));
+}
+
+void ReadBytes(istream &input, void *data, size_t size) {
+  if (!input.read(static_cast<char *>(data), static_cast<streamsize>(size))) {
+    throw runtime_error("database snapshot is truncated");
+  }
+}
+
+void Write(ostream &output, const string &value) {
+  Write(output, static_cast<uint64_t>(value.size()));
+  WriteBytes(output, value.data(), value.size());
+}
+
+void Read(istream &input, string &value) {
+  value.resize(Read<uint64_t>(input));
+  ReadBytes(input, value.data(), value.size());
+}
+
+void WritePadding(ostream &output) {
+  static const char zeros[ARRAY_ALIGNMENT] = {};
+  const auto position = static_cast<size_t>(output.tellp());
+  WriteBytes(output, zeros, (ARRAY_ALIGNMENT - position % ARRAY_ALIGNMENT) % ARRAY_ALIGNMENT);
+}
+
+void SkipPadding(istream &input) {
+  char padding[ARRAY_ALIGNMENT];
+  const auto position = static_cast<size_t>(input.tellg());
+  ReadBytes(input, padding, (ARRAY_ALIGNMENT - position % ARRAY_ALIGNMENT) % ARRAY_ALIGNMENT);
+}
+
+void Write(ostream &output, const StringTable &names) {
+  Write(output, names.GetNames());
+}
+
+void Read(istream &input, StringTable &names) {
+  names = StringTable(Read<FlatLists<char>>(input));
+}
+
+MappedFile::MappedFile(const string &path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    throw runtime_error("can't open " + path);
+  }
+  struct stat file_stat{};
+  if (fstat(fd, &file_stat) == -1) {
+    close(fd);
+    throw runtime_error("can't read " + path);
+  }
+  size_ = static_cast<size_t>(file_stat.st_size);
+  if (size_ > 0) {
+    void *data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      throw runtime_error("can't map " + path);
+    }
+    data_ = static_cast<const char *>(data);
+  }
+  close(fd);  // the mapping stays valid
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    munmap(const_cast<char *>(data_), size_);
+  }
+}
+
+MemoryBuffer::MemoryBuffer(shared_ptr<const void> owner, const char *data, size_t size) : owner_(move(owner)) {
+  // the get area is never written to
+  char *begin = const_cast<char *>(data);
+  setg(begin, begin, begin + size);
+}
+
+MemoryBuffer::MemoryBuffer(const shared_ptr<const MappedFile> &file)
+    : MemoryBuffer(file, file->GetData(), file->GetSize()) {}
+
+const char *MemoryBuffer::Consume(size_t size) {
+  if (static_cast<size_t>(egptr() - gptr()) < size) {
+    throw runtime_error("database snapshot is truncated");
+  }
+  const char *data = gptr();
+  setg(eback(), gptr() + size, egptr());
+  return data;
+}
+
+MemoryBuffer::pos_type MemoryBuffer::seekoff(off_type offset, ios_base::seekdir direction, ios_base::openmode mode) {
+  if (direction == ios_base::cur) {
+    offset += gptr() - eback();
+  } else if (direction == ios_base::end) {
+    offset += egptr() - eback();
+  }
+  return seekpos(offset, mode);
+}
+
+MemoryBuffer::pos_type MemoryBuffer::seekpos(pos_type position, ios_base::openmode mode) {
+  const off_type offset = position;
+  if (!(mode & ios_base::in) || offset < 0 || offset > egptr() - eback()) {
+    return pos_type(off_type(-1));
+  }
+  setg(eback(), eback() + offset, egptr());
+  return position;
+}
+}
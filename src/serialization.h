@@ -0,0 +1,239 @@
+#pragma once
+
+#include "flat_array.h"
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Little binary format for database snapshots: trivially copyable values are stored as raw bytes,
+// strings and containers as their size followed by the items. Types of other modules are supported
+// by Write/Read overloads declared next to them and found by argument-dependent lookup.
+// Flat arrays are aligned in the snapshot, so reading them from a MemoryBuffer, e.g. over a mapped file,
+// gives views into the buffer instead of copies.
+namespace Serialization {
+  const uint32_t SNAPSHOT_MAGIC = 0x42444354;  // "TCDB"
+  const uint32_t SNAPSHOT_VERSION = 3;
+  const size_t ARRAY_ALIGNMENT = 8;
+
+  void WriteHeader(std::ostream &output);
+  void CheckHeader(std::istream &input);
+
+  void WriteBytes(std::ostream &output, const void *data, size_t size);
+  void ReadBytes(std::istream &input, void *data, size_t size);
+
+  // Pad the stream position to ARRAY_ALIGNMENT
+  void WritePadding(std::ostream &output);
+  void SkipPadding(std::istream &input);
+
+  // Read-only memory mapping of a whole file
+  class MappedFile {
+   public:
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *GetData() const { return data_; }
+    size_t GetSize() const { return size_; }
+
+   private:
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+  };
+
+  // Stream buffer over memory owned by owner, which views read from it share
+  class MemoryBuffer : public std::streambuf {
+   public:
+    MemoryBuffer(std::shared_ptr<const void> owner, const char *data, size_t size);
+    explicit MemoryBuffer(const std::shared_ptr<const MappedFile> &file);
+
+    const std::shared_ptr<const void> &GetOwner() const { return owner_; }
+    // Skips size bytes and returns a pointer to them
+    const char *Consume(size_t size);
+
+   protected:
+    pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode) override;
+    pos_type seekpos(pos_type position, std::ios_base::openmode mode) override;
+
+   private:
+    std::shared_ptr<const void> owner_;
+  };
+
+  template <typename T>
+  std::enable_if_t<std::is_trivially_copyable_v<T>> Write(std::ostream &output, const T &value);
+  void Write(std::ostream &output, const std::string &value);
+  template <typename T>
+  void Write(std::ostream &output, const std::vector<T> &values);
+  template <typename T>
+  void Write(std::ostream &output, const std::set<T> &values);
+  template <typename K, typename V>
+  void Write(std::ostream &output, const std::map<K, V> &values);
+  template <typename K, typename V>
+  void Write(std::ostream &output, const std::unordered_map<K, V> &values);
+  template <typename T>
+  void Write(std::ostream &output, const FlatArray<T> &values);
+  template <typename T>
+  void Write(std::ostream &output, const FlatLists<T> &lists);
+  void Write(std::ostream &output, const StringTable &names);
+
+  template <typename T>
+  std::enable_if_t<std::is_trivially_copyable_v<T>> Read(std::istream &input, T &value);
+  void Read(std::istream &input, std::string &value);
+  template <typename T>
+  void Read(std::istream &input, std::vector<T> &values);
+  template <typename T>
+  void Read(std::istream &input, std::set<T> &values);
+  template <typename K, typename V>
+  void Read(std::istream &input, std::map<K, V> &values);
+  template <typename K, typename V>
+  void Read(std::istream &input, std::unordered_map<K, V> &values);
+  template <typename T>
+  void Read(std::istream &input, FlatArray<T> &values);
+  template <typename T>
+  void Read(std::istream &input, FlatLists<T> &lists);
+  void Read(std::istream &input, StringTable &names);
+
+  template <typename T>
+  T Read(std::istream &input) {
+    T value{};
+    Read(input, value);
+    return value;
+  }
+
+
+  template <typename T>
+  std::enable_if_t<std::is_trivially_copyable_v<T>> Write(std::ostream &output, const T &value) {
+    WriteBytes(output, &value, sizeof(value));
+  }
+
+  template <typename T>
+  void Write(std::ostream &output, const std::vector<T> &values) {
+    Write(output, static_cast<uint64_t>(values.size()));
+    if constexpr (std::is_trivially_copyable_v<T>) {
+      WriteBytes(output, values.data(), values.size() * sizeof(T));
+    } else {
+      for (const T &value : values) {
+        Write(output, value);
+      }
+    }
+  }
+
+  template <typename T>
+  void Write(std::ostream &output, const std::set<T> &values) {
+    Write(output, static_cast<uint64_t>(values.size()));
+    for (const T &value : values) {
+      Write(output, value);
+    }
+  }
+
+  template <typename K, typename V>
+  void Write(std::ostream &output, const std::map<K, V> &values) {
+    Write(output, static_cast<uint64_t>(values.size()));
+    for (const auto &[key, value] : values) {
+      Write(output, key);
+      Write(output, value);
+    }
+  }
+
+  template <typename K, typename V>
+  void Write(std::ostream &output, const std::unordered_map<K, V> &values) {
+    Write(output, static_cast<uint64_t>(values.size()));
+    for (const auto &[key, value] : values) {
+      Write(output, key);
+      Write(output, value);
+    }
+  }
+
+  template <typename T>
+  void Write(std::ostream &output, const FlatArray<T> &values) {
+    static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= ARRAY_ALIGNMENT);
+    Write(output, static_cast<uint64_t>(values.size()));
+    WritePadding(output);
+    WriteBytes(output, values.data(), values.size() * sizeof(T));
+  }
+
+  template <typename T>
+  void Write(std::ostream &output, const FlatLists<T> &lists) {
+    Write(output, lists.GetOffsets());
+    Write(output, lists.GetItems());
+  }
+
+  template <typename T>
+  std::enable_if_t<std::is_trivially_copyable_v<T>> Read(std::istream &input, T &value) {
+    ReadBytes(input, &value, sizeof(value));
+  }
+
+  template <typename T>
+  void Read(std::istream &input, std::vector<T> &values) {
+    values.resize(Read<uint64_t>(input));
+    if constexpr (std::is_trivially_copyable_v<T>) {
+      ReadBytes(input, values.data(), values.size() * sizeof(T));
+    } else {
+      for (T &value : values) {
+        Read(input, value);
+      }
+    }
+  }
+
+  template <typename T>
+  void Read(std::istream &input, std::set<T> &values) {
+    values.clear();
+    const auto size = Read<uint64_t>(input);
+    for (uint64_t i = 0; i < size; ++i) {
+      values.insert(values.end(), Read<T>(input));
+    }
+  }
+
+  template <typename K, typename V>
+  void Read(std::istream &input, std::map<K, V> &values) {
+    values.clear();
+    const auto size = Read<uint64_t>(input);
+    for (uint64_t i = 0; i < size; ++i) {
+      K key = Read<K>(input);
+      values.emplace_hint(values.end(), std::move(key), Read<V>(input));
+    }
+  }
+
+  template <typename K, typename V>
+  void Read(std::istream &input, std::unordered_map<K, V> &values) {
+    values.clear();
+    const auto size = Read<uint64_t>(input);
+    values.reserve(size);
+    for (uint64_t i = 0; i < size; ++i) {
+      K key = Read<K>(input);
+      values.emplace(std::move(key), Read<V>(input));
+    }
+  }
+
+  template <typename T>
+  void Read(std::istream &input, FlatArray<T> &values) {
+    static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= ARRAY_ALIGNMENT);
+    const auto size = Read<uint64_t>(input);
+    SkipPadding(input);
+    if (auto *buffer = dynamic_cast<MemoryBuffer *>(input.rdbuf())) {
+      const char *data = buffer->Consume(size * sizeof(T));
+      values = FlatArray<T>::View(buffer->GetOwner(), reinterpret_cast<const T *>(data), size);
+    } else {
+      std::vector<T> items(size);
+      ReadBytes(input, items.data(), size * sizeof(T));
+      values = FlatArray<T>(std::move(items));
+    }
+  }
+
+  template <typename T>
+  void Read(std::istream &input, FlatLists<T> &lists) {
+    auto offsets = Read<FlatArray<uint64_t>>(input);
+    auto items = Read<FlatArray<T>>(input);
+    lists = FlatLists<T>(std::move(offsets), std::move(items));
+  }
+}
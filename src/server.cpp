@@ -0,0 +1,164 @@
+#include "server.h"
+#include "json.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+
+namespace Server {
+  namespace {
+    // Buffered reading and writing of a connected socket, which is closed with the buffer
+    class SocketBuffer : public streambuf {
+     public:
+      explicit SocketBuffer(int socket) : socket_(socket) {
+        setg(input_, input_, input_);
+        setp(output_, output_ + BUFFER_SIZE);
+      }
+      ~SocketBuffer() override {
+        Send();
+        close(socket_);
+      }
+      SocketBuffer(const SocketBuffer &) = delete;
+      SocketBuffer &operator=(const SocketBuffer &) = delete;
+
+     protected:
+      int_type underflow() override {
+        ssize_t size;
+        do {
+          size = recv(socket_, input_, BUFFER_SIZE, 0);
+        } while (size < 0 && errno == EINTR);
+        if (size <= 0) {
+          return traits_type::eof();
+        }
+        setg(input_, input_, input_ + size);
+        return traits_type::to_int_type(*gptr());
+      }
+
+      int_type overflow(int_type c) override {
+        if (!Send()) {
+          return traits_type::eof();
+        }
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+          *pptr() = traits_type::to_char_type(c);
+          pbump(1);
+        }
+        return traits_type::not_eof(c);
+      }
+
+      int sync() override {
+        return Send() ? 0 : -1;
+      }
+
+     private:
+      static const size_t BUFFER_SIZE = 1 << 16;
+
+      // the client may be gone, which must not kill the process with SIGPIPE
+      bool Send() {
+        for (const char *data = pbase(); data < pptr();) {
+          const ssize_t size = send(socket_, data, pptr() - data, MSG_NOSIGNAL);
+          if (size < 0 && errno == EINTR) {
+            continue;
+          }
+          if (size < 0) {
+            return false;
+          }
+          data += size;
+        }
+        setp(output_, output_ + BUFFER_SIZE);
+        return true;
+      }
+
+      int socket_;
+      char input_[BUFFER_SIZE];
+      char output_[BUFFER_SIZE];
+    };
+
+    string ProcessLine(const TransportDatabase &db, const TransportInformer::Informer &informer,
+                       string_view line, optional<int> precision) {
+      ostringstream response;
+      optional<int> request_id;
+      try {
+        const Json::Document request = Json::Load(line);
+        if (!request.GetRoot().IsMap()) {
+          throw runtime_error("request is not a dict");
+        }
+        const Json::Dict &request_info = request.GetRoot().AsMap();
+        if (const auto it = request_info.find("id"); it != request_info.end() && it->second.IsInt()) {
+          request_id = it->second.AsInt();
+        }
+        Json::Writer writer(response, precision);
+        informer.ProcessRequest(db, request_info, writer);
+      } catch (const exception &error) {
+        response.str({});
+        Json::Writer writer(response);
+        writer.StartDict();
+        if (request_id) {
+          writer.Key("request_id");
+          writer.Int(*request_id);
+        }
+        writer.Key("error_message");
+        writer.String(error.what());
+        writer.EndDict();
+      }
+      return response.str();
+    }
+  }
+
+  void Serve(const TransportDatabase &db, const TransportInformer::Informer &informer,
+             istream &input, ostream &output, optional<int> precision) {
+    string line;
+    while (output && getline(input, line)) {
+      if (line.find_first_not_of(" \t\r") == string::npos) {
+        continue;
+      }
+      output << ProcessLine(db, informer, line, precision) << '\n' << flush;
+    }
+  }
+
+  void ServeUnixSocket(const string &path, const TransportDatabase &db,
+                       const TransportInformer::Informer &informer, optional<int> precision) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+      throw runtime_error("socket path is too long: " + path);
+    }
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener == -1) {
+      throw runtime_error("can't create socket");
+    }
+    unlink(path.c_str());
+    if (bind(listener, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == -1
+        || listen(listener, SOMAXCONN) == -1) {
+      close(listener);
+      throw runtime_error("can't listen on " + path);
+    }
+
+    for (;;) {
+      const int connection = accept(listener, nullptr, nullptr);
+      if (connection == -1) {
+        if (errno == EINTR || errno == ECONNABORTED) {
+          continue;
+        }
+        close(listener);
+        throw runtime_error("can't accept connections on " + path);
+      }
+      thread([connection, &db, &informer, precision] {
+        auto buffer = make_unique<SocketBuffer>(connection);
+        istream input(buffer.get());
+        ostream output(buffer.get());
+        Serve(db, informer, input, output, precision);
+      }).detach();
+    }
+  }
+}
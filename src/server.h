@@ -0,0 +1,24 @@
+#pragma once
+
+#include "transport_database.h"
+#include "transport_informer.h"
+
+#include <iostream>
+#include <optional>
+#include <string>
+
+// Long-running serving of a database built once: requests come as newline-delimited JSON,
+// one request object per line, and every response is written as a line as soon as it is ready
+namespace Server {
+  using TransportDatabase = TransportDatabase::Database;
+
+  // Answers the lines of input until it ends or output fails; empty lines are skipped.
+  // A line which is not a valid request is answered with its error message, and serving goes on.
+  void Serve(const TransportDatabase &db, const TransportInformer::Informer &informer,
+             std::istream &input, std::ostream &output, std::optional<int> precision = std::nullopt);
+
+  // Listens on a Unix domain socket at path, replacing a stale socket file, and serves every
+  // connection on its own thread like Serve; never returns unless it fails to accept connections
+  void ServeUnixSocket(const std::string &path, const TransportDatabase &db,
+                       const TransportInformer::Informer &informer, std::optional<int> precision = std::nullopt);
+}
@@ -0,0 +1,63 @@
+#include "spatial_index.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace Visualisation {
+SpatialIndex::SpatialIndex(vector<Rect> bounds) : bounds_(move(bounds)) {
+  if (bounds_.empty())
+    return;
+  area_ = bounds_.front();
+  for (const Rect &rect : bounds_) {
+    area_.min = {min(area_.min.x, rect.min.x), min(area_.min.y, rect.min.y)};
+    area_.max = {max(area_.max.x, rect.max.x), max(area_.max.y, rect.max.y)};
+  }
+  // about one element per cell
+  grid_size_ = clamp<size_t>(static_cast<size_t>(sqrt(static_cast<double>(bounds_.size()))), 1, MAX_GRID_SIZE);
+  cell_width_ = (area_.max.x - area_.min.x) / static_cast<double>(grid_size_);
+  cell_height_ = (area_.max.y - area_.min.y) / static_cast<double>(grid_size_);
+
+  vector<vector<uint32_t>> cells(grid_size_ * grid_size_);
+  for (uint32_t id = 0; id < bounds_.size(); ++id) {
+    const Rect &rect = bounds_[id];
+    for (size_t row = GetRow(rect.min.y); row <= GetRow(rect.max.y); ++row) {
+      for (size_t column = GetColumn(rect.min.x); column <= GetColumn(rect.max.x); ++column) {
+        cells[row * grid_size_ + column].push_back(id);
+      }
+    }
+  }
+  cells_ = FlatLists<uint32_t>::Build(cells);
+}
+
+vector<uint32_t> SpatialIndex::Find(const Rect &rect) const {
+  vector<uint32_t> result;
+  if (bounds_.empty() || !area_.Intersects(rect))
+    return result;
+  for (size_t row = GetRow(rect.min.y); row <= GetRow(rect.max.y); ++row) {
+    for (size_t column = GetColumn(rect.min.x); column <= GetColumn(rect.max.x); ++column) {
+      for (const uint32_t id : cells_[row * grid_size_ + column]) {
+        if (bounds_[id].Intersects(rect))
+          result.push_back(id);
+      }
+    }
+  }
+  // elements spanning several cells are met once per cell
+  sort(result.begin(), result.end());
+  result.erase(unique(result.begin(), result.end()), result.end());
+  return result;
+}
+
+size_t SpatialIndex::GetColumn(double x) const {
+  if (cell_width_ <= 0 || x <= area_.min.x)
+    return 0;
+  return min(static_cast<size_t>((x - area_.min.x) / cell_width_), grid_size_ - 1);
+}
+
+size_t SpatialIndex::GetRow(double y) const {
+  if (cell_height_ <= 0 || y <= area_.min.y)
+    return 0;
+  return min(static_cast<size_t>((y - area_.min.y) / cell_height_), grid_size_ - 1);
+}
+}
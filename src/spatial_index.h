@@ -0,0 +1,42 @@
+#pragma once
+
+#include "flat_array.h"
+#include "svg.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace Visualisation {
+struct Rect {
+  Svg::Point min;
+  Svg::Point max;
+
+  bool Intersects(const Rect &other) const {
+    return min.x <= other.max.x && other.min.x <= max.x && min.y <= other.max.y && other.min.y <= max.y;
+  }
+};
+
+// Uniform grid over the bounds of elements; an element is listed in every cell its bounds touch,
+// so a lookup visits only the elements near the rect
+class SpatialIndex {
+ public:
+  SpatialIndex() = default;
+  explicit SpatialIndex(std::vector<Rect> bounds);
+
+  // ids of the elements whose bounds intersect the rect, ascending; ids are positions of the given bounds
+  std::vector<uint32_t> Find(const Rect &rect) const;
+
+ private:
+  static constexpr size_t MAX_GRID_SIZE = 1024;
+
+  std::vector<Rect> bounds_;
+  Rect area_{};
+  size_t grid_size_ = 0;  // cells along each axis
+  double cell_width_ = 0.;
+  double cell_height_ = 0.;
+  FlatLists<uint32_t> cells_;  // row by row
+
+  size_t GetColumn(double x) const;
+  size_t GetRow(double y) const;
+};
+}
@@ -1,7 +1,11 @@
 #pragma once
+#include <charconv>
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -256,4 +260,152 @@ class Document {
  private:
   std::vector<std::unique_ptr<ISvgObject>> objects_;
 };
+
+// Appearance of an element written by Writer; colors and names are referenced, not copied
+struct Style {
+  std::string_view fill_color;  // empty color is none
+  std::string_view stroke_color;
+  double stroke_width = 1.0;
+  std::string_view line_cap;
+  std::string_view line_join;
+};
+
+struct Font {
+  uint32_t size = 1;
+  std::string_view family;
+  std::string_view weight;
+};
+
+// Append-only document: elements are written straight into one buffer in the order they come,
+// without an object per element. The output is the same as the one of Document with the same elements.
+class Writer {
+ public:
+  struct ViewBox {
+    Point origin;
+    double width;
+    double height;
+  };
+
+  Writer() {
+    WriteHeader();
+    buffer_ += '>';
+  }
+  // Document showing only the given part of the plane
+  explicit Writer(const ViewBox &view_box) {
+    WriteHeader();
+    buffer_ += R"( viewBox=")";
+    WriteNumber(view_box.origin.x);
+    buffer_ += ' ';
+    WriteNumber(view_box.origin.y);
+    buffer_ += ' ';
+    WriteNumber(view_box.width);
+    buffer_ += ' ';
+    WriteNumber(view_box.height);
+    buffer_ += R"(">)";
+  }
+
+  void Circle(Point center, double radius, const Style &style) {
+    buffer_ += "<circle ";
+    WriteAttribute("cx", center.x);
+    WriteAttribute("cy", center.y);
+    WriteAttribute("r", radius);
+    WriteStyle(style);
+    buffer_ += "/>";
+  }
+
+  void Rectangle(Point origin, double width, double height, const Style &style) {
+    buffer_ += "<rect ";
+    WriteAttribute("x", origin.x);
+    WriteAttribute("y", origin.y);
+    WriteAttribute("width", width);
+    WriteAttribute("height", height);
+    WriteStyle(style);
+    buffer_ += "/>";
+  }
+
+  // Points of a polyline are added between BeginPolyline and EndPolyline
+  void BeginPolyline() {
+    buffer_ += "<polyline points=\"";
+  }
+  void AddPoint(Point point) {
+    WriteNumber(point.x);
+    buffer_ += ',';
+    WriteNumber(point.y);
+    buffer_ += ' ';
+  }
+  void EndPolyline(const Style &style) {
+    buffer_ += "\" ";
+    WriteStyle(style);
+    buffer_ += "/>";
+  }
+
+  void Text(Point point, Point offset, const Font &font, const Style &style, std::string_view data) {
+    buffer_ += "<text ";
+    WriteAttribute("x", point.x);
+    WriteAttribute("y", point.y);
+    WriteAttribute("dx", offset.x);
+    WriteAttribute("dy", offset.y);
+    WriteAttribute("font-size", font.size);
+    WriteOptionalAttribute("font-family", font.family);
+    WriteOptionalAttribute("font-weight", font.weight);
+    WriteStyle(style);
+    buffer_ += '>';
+    buffer_ += data;
+    buffer_ += "</text>";
+  }
+
+  // Closes the document and returns it
+  std::string Finish() && {
+    buffer_ += "</svg>";
+    return std::move(buffer_);
+  }
+
+ private:
+  void WriteHeader() {
+    buffer_ += R"(<?xml version="1.0" encoding="UTF-8" ?>)";
+    buffer_ += R"(<svg xmlns="http://www.w3.org/2000/svg" version="1.1")";
+  }
+
+  // the default format of streams: 6 significant digits
+  void WriteNumber(double value) {
+    char chars[32];
+    const auto result = std::to_chars(std::begin(chars), std::end(chars), value, std::chars_format::general, 6);
+    buffer_.append(chars, result.ptr);
+  }
+  void WriteNumber(uint32_t value) {
+    char chars[16];
+    const auto result = std::to_chars(std::begin(chars), std::end(chars), value);
+    buffer_.append(chars, result.ptr);
+  }
+
+  template <typename Value>
+  void WriteAttribute(std::string_view name, Value value) {
+    buffer_ += name;
+    buffer_ += "=\"";
+    if constexpr (std::is_arithmetic_v<Value>) {
+      WriteNumber(value);
+    } else {
+      buffer_ += value;
+    }
+    buffer_ += "\" ";
+  }
+  void WriteOptionalAttribute(std::string_view name, std::string_view value) {
+    if (!value.empty()) {
+      WriteAttribute(name, value);
+    }
+  }
+  void WriteColor(std::string_view name, std::string_view color) {
+    WriteAttribute(name, color.empty() ? std::string_view("none") : color);
+  }
+
+  void WriteStyle(const Style &style) {
+    WriteColor("fill", style.fill_color);
+    WriteColor("stroke", style.stroke_color);
+    WriteAttribute("stroke-width", style.stroke_width);
+    WriteOptionalAttribute("stroke-linecap", style.line_cap);
+    WriteOptionalAttribute("stroke-linejoin", style.line_join);
+  }
+
+  std::string buffer_;
+};
 }
@@ -1,75 +1,298 @@
 #include "transport_data.h"
 
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <tuple>
+
 using namespace std;
 
 namespace TransportData {
 
-  Stop Stop::ParseStop(const Json::Dict &info) {
-    Stop stop = {
-        .name = info.at("name").AsString(),
-        .position = {
-            .latitude = info.at("latitude").AsDouble(),
-            .longitude = info.at("longitude").AsDouble(),
-        }
-    };
-    if (info.count("road_distances") > 0) {
-      for (const auto& [neighbour_stop, distance_node] : info.at("road_distances").AsMap()) {
-        stop.distances[neighbour_stop] = distance_node.AsInt();
-      }
+  uint32_t NameInterner::Intern(string_view name) {
+    if (auto it = ids_.find(name); it != ids_.end()) {
+      return it->second;
     }
-    return stop;
+    const auto id = static_cast<uint32_t>(names_.size());
+    ids_.emplace(names_.emplace_back(name), id);
+    return id;
+  }
+
+  void DataBuilder::Add(const Json::Dict &info) {
+    StartDict();
+    for (const auto &[key, value] : info) {
+      Key(key);
+      Json::WriteNode(value, *this);
+    }
+    EndDict();
+  }
+
+  void DataBuilder::StartArray() {
+    ++depth_;
+  }
+
+  void DataBuilder::EndArray() {
+    --depth_;
   }
 
-  vector<string> ParseStops(const vector<Json::Node> &stop_nodes, bool is_roundtrip) {
-    vector<string> stops;
-    stops.reserve(stop_nodes.size());
-    for (const Json::Node &stop_node : stop_nodes) {
-      stops.emplace_back(stop_node.AsString());
+  void DataBuilder::StartDict() {
+    if (++depth_ == 1) {
+      request_.type.clear();
+      request_.name.reset();
+      request_.latitude.reset();
+      request_.longitude.reset();
+      request_.is_roundtrip.reset();
+      request_.has_stops = false;
+      request_.stops.clear();
+      request_.road_distances.clear();
+      field_ = Field::Other;
     }
-    if (is_roundtrip || stops.size() <= 1) {
-      return stops;
+  }
+
+  void DataBuilder::EndDict() {
+    if (depth_-- == 1) {
+      FinishRequest();
     }
+  }
 
-    // adding stops for reverse path
-    stops.reserve(stops.size() * 2 - 1);
-    for (size_t stop_idx = stops.size() - 1; stop_idx > 0; --stop_idx) {
-      stops.emplace_back(stops[stop_idx - 1]);
+  void DataBuilder::Key(string_view key) {
+    if (depth_ == 2 && field_ == Field::RoadDistances) {
+      neighbour_stop_id_ = stop_names_.Intern(key);
+    } else if (depth_ != 1) {
+      return;
+    } else if (key == "type") {
+      field_ = Field::Type;
+    } else if (key == "name") {
+      field_ = Field::Name;
+    } else if (key == "latitude") {
+      field_ = Field::Latitude;
+    } else if (key == "longitude") {
+      field_ = Field::Longitude;
+    } else if (key == "is_roundtrip") {
+      field_ = Field::IsRoundtrip;
+    } else if (key == "stops") {
+      field_ = Field::Stops;
+      request_.has_stops = true;
+    } else if (key == "road_distances") {
+      field_ = Field::RoadDistances;
+    } else {
+      field_ = Field::Other;
     }
-    return stops;
   }
 
-  int ComputeAdjacentStopsDistance(const Stop &lhs, const Stop &rhs) {
-    if (auto it = lhs.distances.find(rhs.name); it != lhs.distances.end()) {
-      return it->second;
+  void DataBuilder::String(string_view value) {
+    if (depth_ == 2 && field_ == Field::Stops) {
+      request_.stops.push_back(stop_names_.Intern(value));
+    } else if (depth_ == 1 && field_ == Field::Type) {
+      request_.type = value;
+    } else if (depth_ == 1 && field_ == Field::Name) {
+      request_.name.emplace(value);
+    }
+  }
+
+  void DataBuilder::Int(int value) {
+    if (depth_ == 2 && field_ == Field::RoadDistances) {
+      request_.road_distances.emplace_back(neighbour_stop_id_, value);
+    } else {
+      SetNumber(value);
+    }
+  }
+
+  void DataBuilder::Double(double value) {
+    SetNumber(value);
+  }
+
+  void DataBuilder::SetNumber(double value) {
+    if (depth_ == 1 && field_ == Field::Latitude) {
+      request_.latitude = value;
+    } else if (depth_ == 1 && field_ == Field::Longitude) {
+      request_.longitude = value;
+    }
+  }
+
+  void DataBuilder::Bool(bool value) {
+    if (depth_ == 1 && field_ == Field::IsRoundtrip) {
+      request_.is_roundtrip = value;
+    }
+  }
+
+  void DataBuilder::FinishRequest() {
+    if (request_.type == "Bus") {
+      AddBus();
+    } else if (request_.type == "Stop") {
+      AddStop();
     } else {
-      return rhs.distances.at(lhs.name);
+      throw runtime_error("Unexpected query type");
     }
   }
 
-  Bus Bus::ParseBus(const Json::Dict &info) {
-    return Bus{
-        .name = info.at("name").AsString(),
-        .is_roundtrip = info.at("is_roundtrip").AsBool(),
-        .stops = ParseStops(info.at("stops").AsArray(), info.at("is_roundtrip").AsBool())
+  void DataBuilder::AddStop() {
+    if (!request_.name || !request_.latitude || !request_.longitude) {
+      throw runtime_error("stop without name or coordinates");
+    }
+    const StopId stop_id = stop_names_.Intern(*request_.name);
+    stops_.resize(stop_names_.size());
+    if (stops_[stop_id]) {
+      return;
+    }
+    stops_[stop_id] = Stop{
+        .position = {
+            .latitude = *request_.latitude,
+            .longitude = *request_.longitude,
+        }
     };
+    for (const auto &[neighbour_stop_id, distance] : request_.road_distances) {
+      road_distances_.push_back({stop_id, neighbour_stop_id, distance});
+    }
   }
 
-  vector<DataQuery> ReadData(const vector<Json::Node> &nodes) {
-    vector<DataQuery> result;
-    result.reserve(nodes.size());
+  void DataBuilder::AddBus() {
+    if (!request_.name || !request_.is_roundtrip || !request_.has_stops) {
+      throw runtime_error("bus without name, is_roundtrip or stops");
+    }
+    const BusId bus_id = bus_names_.Intern(*request_.name);
+    stops_.resize(stop_names_.size());
+    buses_.resize(bus_names_.size());
+    if (buses_[bus_id]) {
+      return;
+    }
+    const bool is_roundtrip = *request_.is_roundtrip;
+    const vector<StopId> &route = request_.stops;
+    vector<StopId> stops;
+    stops.reserve(is_roundtrip ? route.size() : route.size() * 2);
+    stops.assign(route.begin(), route.end());
+    if (!is_roundtrip && route.size() > 1) {
+      // adding stops for reverse path
+      stops.insert(stops.end(), next(route.rbegin()), route.rend());
+    }
+    buses_[bus_id] = Bus{is_roundtrip, move(stops)};
+  }
 
-    for (const Json::Node &node : nodes) {
-      const auto &node_dict = node.AsMap();
-      const string type = node_dict.at("type").AsString();
-      if (type == "Bus") {
-        result.emplace_back(Bus::ParseBus(node_dict));
-      } else if (type == "Stop") {
-        result.emplace_back(Stop::ParseStop(node_dict));
-      } else {
-        throw runtime_error("Unexpected query type");
+  Data DataBuilder::Build() && {
+    // names met only among road distances have no stops yet
+    stops_.resize(stop_names_.size());
+    vector<string_view> stop_names;
+    for (StopId stop_id = 0; stop_id < stops_.size(); ++stop_id) {
+      if (stops_[stop_id]) {
+        stop_names.push_back(stop_names_[stop_id]);
+      }
+    }
+    vector<string_view> bus_names;
+    for (BusId bus_id = 0; bus_id < buses_.size(); ++bus_id) {
+      bus_names.push_back(bus_names_[bus_id]);
+    }
+    Data data{StringTable::FromNames(move(stop_names)), StringTable::FromNames(move(bus_names))};
+
+    // only described stops get ids; road distances to the others are dropped
+    vector<optional<StopId>> stop_ids(stops_.size());
+    for (StopId stop_id = 0; stop_id < stops_.size(); ++stop_id) {
+      if (stops_[stop_id]) {
+        stop_ids[stop_id] = static_cast<StopId>(*data.stop_names.Find(stop_names_[stop_id]));
+      }
+    }
+
+    data.stops.resize(data.stop_names.size());
+    for (StopId stop_id = 0; stop_id < stops_.size(); ++stop_id) {
+      if (stops_[stop_id]) {
+        data.stops[*stop_ids[stop_id]] = move(*stops_[stop_id]);
+      }
+    }
+    vector<RoadDistance> road_distances;
+    road_distances.reserve(road_distances_.size());
+    for (const auto [from, to, distance] : road_distances_) {
+      if (stop_ids[to]) {
+        road_distances.push_back({*stop_ids[from], *stop_ids[to], distance});
+      }
+    }
+    data.road_distances = RoadDistances(data.stops.size(), road_distances);
+
+    data.buses.resize(data.bus_names.size());
+    for (BusId bus_id = 0; bus_id < buses_.size(); ++bus_id) {
+      Bus &bus = data.buses[*data.bus_names.Find(bus_names_[bus_id])];
+      bus = move(*buses_[bus_id]);
+      for (StopId &stop_id : bus.stops) {
+        if (!stop_ids[stop_id]) {
+          throw out_of_range("unknown stop " + string(stop_names_[stop_id]));
+        }
+        stop_id = *stop_ids[stop_id];
+      }
+      bus.distances.reserve(bus.stops.size());
+      for (size_t stop_idx = 0; stop_idx < bus.stops.size(); ++stop_idx) {
+        if (stop_idx == 0) {
+          bus.distances.push_back(0);
+          continue;
+        }
+        const StopId from = bus.stops[stop_idx - 1];
+        const StopId to = bus.stops[stop_idx];
+        const auto distance = data.road_distances.Find(from, to);
+        if (!distance) {
+          throw out_of_range("no road distance between " + string(data.stop_names[from])
+                             + " and " + string(data.stop_names[to]));
+        }
+        bus.distances.push_back(bus.distances.back() + *distance);
       }
     }
 
-    return result;
+    // buses are visited in the order of ids, so bus lists of stops come out sorted
+    for (BusId bus_id = 0; bus_id < data.buses.size(); ++bus_id) {
+      for (const StopId stop_id : data.buses[bus_id].stops) {
+        auto &bus_ids = data.stops[stop_id].bus_ids;
+        if (bus_ids.empty() || bus_ids.back() != bus_id) {
+          bus_ids.push_back(bus_id);
+        }
+      }
+    }
+    return data;
+  }
+
+  RoadDistances::RoadDistances(size_t stop_count, const vector<RoadDistance> &distances) {
+    // given distances go before the mirrored ones of the same pair, which then are dropped
+    vector<tuple<StopId, StopId, bool, int>> items;
+    items.reserve(distances.size() * 2);
+    for (const auto [from, to, distance] : distances) {
+      items.emplace_back(from, to, false, distance);
+      items.emplace_back(to, from, true, distance);
+    }
+    sort(items.begin(), items.end());
+
+    vector<uint64_t> offsets{0};
+    vector<Neighbour> neighbours;
+    neighbours.reserve(items.size());
+    auto it = items.begin();
+    for (StopId stop_id = 0; stop_id < stop_count; ++stop_id) {
+      for (; it != items.end() && get<0>(*it) == stop_id; ++it) {
+        if (neighbours.size() == offsets.back() || neighbours.back().stop_id != get<1>(*it)) {
+          neighbours.push_back({get<1>(*it), get<3>(*it)});
+        }
+      }
+      offsets.push_back(neighbours.size());
+    }
+    neighbours_ = FlatLists<Neighbour>(move(offsets), move(neighbours));
+  }
+
+  optional<int> RoadDistances::Find(StopId from, StopId to) const {
+    const auto neighbours = neighbours_[from];
+    const auto it = lower_bound(neighbours.begin(), neighbours.end(), to, [](const Neighbour &neighbour, StopId stop_id) {
+      return neighbour.stop_id < stop_id;
+    });
+    if (it != neighbours.end() && it->stop_id == to) {
+      return it->distance;
+    }
+    return nullopt;
+  }
+
+  int RoadDistances::Get(StopId from, StopId to) const {
+    if (const auto distance = Find(from, to)) {
+      return *distance;
+    }
+    throw out_of_range("no road distance between stops " + to_string(from) + " and " + to_string(to));
+  }
+
+  Data ReadData(const vector<Json::Node> &nodes) {
+    DataBuilder builder;
+    for (const Json::Node &node : nodes) {
+      builder.Add(node.AsMap());
+    }
+    return move(builder).Build();
   }
 }
@@ -1,39 +1,131 @@
 #pragma once
 
+#include "flat_array.h"
 #include "json.h"
 #include "location.h"
 
-#include <set>
+#include <cstdint>
+#include <deque>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
-#include <variant>
+#include <utility>
 #include <vector>
 
 namespace TransportData {
+  // Stops and buses are referred to by dense ids; names are only used at the JSON boundary
+  using StopId = uint32_t;
+  using BusId = uint32_t;
+
   struct Stop {
-    std::string name;
     Location::Point position;
-    std::unordered_map<std::string, int> distances;
-    std::set<std::string> bus_names;
+    std::vector<BusId> bus_ids;  // sorted
+  };
+
+  struct Bus {
+    bool is_roundtrip;
+    std::vector<StopId> stops;
+    // road distance from the first stop to every stop of the route, so a segment length is a subtraction
+    std::vector<int> distances;
+  };
 
-    static Stop ParseStop(const Json::Dict &info);
+  struct RoadDistance {
+    StopId from;
+    StopId to;
+    int distance;
   };
 
-  int ComputeAdjacentStopsDistance(const Stop &lhs, const Stop &rhs);
+  // Road distances by pairs of stops. A distance given for one direction only serves the other one too;
+  // that is resolved when the index is built, so a lookup is a search among the neighbours of one stop.
+  class RoadDistances {
+   public:
+    RoadDistances() = default;
+    RoadDistances(size_t stop_count, const std::vector<RoadDistance> &distances);
 
-  std::vector<std::string> ParseStops(const std::vector<Json::Node> &stop_nodes, bool is_roundtrip);
+    std::optional<int> Find(StopId from, StopId to) const;
+    int Get(StopId from, StopId to) const;
 
-  struct Bus {
-    std::string name;
-    bool is_roundtrip;
-    std::vector<std::string> stops;
+   private:
+    struct Neighbour {
+      StopId stop_id;
+      int distance;
+    };
+    FlatLists<Neighbour> neighbours_;  // sorted by stop id
+  };
 
-    static Bus ParseBus(const Json::Dict &info);
+  // Ids of stops and buses are positions of their names in the sorted name tables
+  struct Data {
+    StringTable stop_names;
+    StringTable bus_names;
+    std::vector<Stop> stops;
+    std::vector<Bus> buses;
+    RoadDistances road_distances;
   };
 
-  using DataQuery = std::variant<Stop, Bus>;
-  using StopsDict = std::unordered_map<std::string, TransportData::Stop>;
-  using BusesDict = std::unordered_map<std::string, TransportData::Bus>;
+  // Assigns dense ids to names in the order they are first met
+  class NameInterner {
+   public:
+    uint32_t Intern(std::string_view name);
+    std::string_view operator[](uint32_t id) const { return names_[id]; }
+    size_t size() const { return names_.size(); }
+
+   private:
+    std::deque<std::string> names_;  // deque keeps the names in place for the views in ids_
+    std::unordered_map<std::string_view, uint32_t> ids_;
+  };
+
+  // Parses base requests one by one, interning the names, and renumbers stops and buses
+  // in the order of their names once all of them are known. Requests come as dicts or as
+  // parsing events of the items of base_requests, which are read without building nodes.
+  class DataBuilder : public Json::Handler {
+   public:
+    void Add(const Json::Dict &info);
+    Data Build() &&;
+
+    void StartArray() override;
+    void EndArray() override;
+    void StartDict() override;
+    void EndDict() override;
+    void Key(std::string_view key) override;
+    void String(std::string_view value) override;
+    void Int(int value) override;
+    void Double(double value) override;
+    void Bool(bool value) override;
+
+   private:
+    enum class Field { Other, Type, Name, Latitude, Longitude, IsRoundtrip, Stops, RoadDistances };
+
+    // fields of the request being parsed; its buffers are kept for the next one
+    struct Request {
+      std::string type;
+      std::optional<std::string> name;
+      std::optional<double> latitude;
+      std::optional<double> longitude;
+      std::optional<bool> is_roundtrip;
+      bool has_stops = false;
+      std::vector<StopId> stops;
+      std::vector<std::pair<StopId, int>> road_distances;
+    };
+
+    void SetNumber(double value);
+    void FinishRequest();
+    void AddStop();
+    void AddBus();
+
+    Request request_;
+    // of the containers open in the request
+    size_t depth_ = 0;
+    Field field_ = Field::Other;
+    StopId neighbour_stop_id_ = 0;
+
+    NameInterner stop_names_;
+    NameInterner bus_names_;
+    // by interned id; stops may be mentioned by buses and road distances before they are described
+    std::vector<std::optional<Stop>> stops_;
+    std::vector<std::optional<Bus>> buses_;
+    std::vector<RoadDistance> road_distances_;
+  };
 
-  std::vector<DataQuery> ReadData(const std::vector<Json::Node> &nodes);
+  Data ReadData(const std::vector<Json::Node> &nodes);
 }
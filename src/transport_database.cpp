@@ -1,82 +1,169 @@
 #include "transport_database.h"
+#include "serialization.h"
+#include "parallel.h"
+#include "profiler.h"
 
 #include <sstream>
 
 namespace TransportDatabase {
 using namespace std;
 
-Database::Database(vector<TransportData::DataQuery> data, const Json::Dict &routing_settings) {
-  auto stops_end = partition(begin(data), end(data), [](const auto &item) {
-    return holds_alternative<TransportData::Stop>(item);
+Database::Database(TransportData::Data data, const Json::Dict &routing_settings, size_t thread_count) {
+  // errors of the settings surface here rather than on the first route request
+  TransportRouter::CheckSettings(routing_settings);
+  auto shared_data = make_shared<const TransportData::Data>(move(data));
+  auto build_router = [shared_data, routing_settings, thread_count] {
+    return make_unique<TransportRouter>(*shared_data, routing_settings, thread_count);
+  };
+  if (thread_count > 1) {
+    pending_router_ = async(launch::async, move(build_router));
+  } else {
+    router_ = build_router();
+  }
+  Profiler::ScopedTimer timer("database.tables");
+  BuildTables(*shared_data, thread_count);
+  Profiler::AddCount("stops", stop_names_.size());
+  Profiler::AddCount("buses", bus_names_.size());
+}
+
+const TransportRouter &Database::GetRouter() const {
+  call_once(*router_ready_, [this] {
+    if (pending_router_.valid()) {
+      try {
+        router_ = pending_router_.get();
+      } catch (...) {
+        router_error_ = current_exception();
+      }
+    }
   });
+  // a failed build fails every request needing the router, not only the first one
+  if (router_error_) {
+    rethrow_exception(router_error_);
+  }
+  return *router_;
+}
 
-  for (auto &item : Range{begin(data), stops_end}) {
-    auto &stop = get<TransportData::Stop>(item);
-    stop_responses_.insert({stop.name, {}});
-    stops_data_.emplace(stop.name, move(stop));
+void Database::BuildTables(const TransportData::Data &data, size_t thread_count) {
+  stop_names_ = data.stop_names;
+  bus_names_ = data.bus_names;
+
+  vector<Location::Point> stop_positions;
+  stop_positions.reserve(data.stops.size());
+  for (const TransportData::Stop &stop : data.stops) {
+    stop_positions.push_back(stop.position);
   }
 
-  for (auto &item : Range{stops_end, end(data)}) {
-    auto &bus = get<TransportData::Bus>(item);
-    bus_responses_[bus.name] = Responses::Bus{
-        bus.stops.size(),
-        ComputeUniqueItemsCount(AsRange(bus.stops)),
-        ComputeRoadRouteLength(bus.stops, stops_data_),
-        ComputeGeoRouteDistance(bus.stops, stops_data_)
-    };
-
-    // Adding bus info to stops
-    for (const string &stop_name : bus.stops) {
-      stop_responses_.at(stop_name).bus_names.insert(bus.name);
-      stops_data_.at(stop_name).bus_names.insert(bus.name);
+  vector<Responses::Bus> bus_responses(data.buses.size());
+  Parallel::RunInChunks(data.buses.size(), BUSES_PER_CHUNK, thread_count, [&](size_t begin, size_t end) {
+    for (TransportData::BusId bus_id = begin; bus_id < end; ++bus_id) {
+      const TransportData::Bus &bus = data.buses[bus_id];
+      bus_responses[bus_id] = {
+          bus.stops.size(),
+          ComputeUniqueItemsCount(AsRange(bus.stops)),
+          bus.distances.empty() ? 0 : bus.distances.back(),
+          ComputeGeoRouteDistance(bus.stops, data)
+      };
     }
+  });
+  vector<uint8_t> bus_is_roundtrip;
+  bus_is_roundtrip.reserve(data.buses.size());
+  for (const TransportData::Bus &bus : data.buses) {
+    bus_is_roundtrip.push_back(bus.is_roundtrip);
+  }
 
-    buses_data_.emplace(bus.name, move(bus));
+  stop_positions_ = move(stop_positions);
+  stop_bus_ids_ = FlatLists<TransportData::BusId>::Build(
+      data.stops, [](const TransportData::Stop &stop) -> const auto & { return stop.bus_ids; });
+  bus_responses_ = move(bus_responses);
+  bus_is_roundtrip_ = move(bus_is_roundtrip);
+  bus_stop_ids_ = FlatLists<TransportData::StopId>::Build(
+      data.buses, [](const TransportData::Bus &bus) -> const auto & { return bus.stops; });
+}
+
+optional<TransportData::StopId> Database::FindStopId(string_view name) const {
+  if (const auto stop_id = stop_names_.Find(name)) {
+    return static_cast<TransportData::StopId>(*stop_id);
   }
+  return nullopt;
+}
 
-  router_ = make_unique<TransportRouter>(stops_data_, buses_data_, routing_settings);
+optional<TransportData::BusId> Database::FindBusId(string_view name) const {
+  if (const auto bus_id = bus_names_.Find(name)) {
+    return static_cast<TransportData::BusId>(*bus_id);
+  }
+  return nullopt;
 }
 
 optional<const Responses::Stop> Database::GetStopInfo(const string &name) const {
-  if (stop_responses_.count(name) != 0) {
-    return stop_responses_.at(name);
-  } else {
+  const auto stop_id = stop_names_.Find(name);
+  if (!stop_id) {
     return nullopt;
   }
+  Responses::Stop response;
+  for (const TransportData::BusId bus_id : stop_bus_ids_[*stop_id]) {
+    response.bus_names.emplace_hint(response.bus_names.end(), bus_names_[bus_id]);
+  }
+  return response;
 }
 
 optional<const Responses::Bus> Database::GetBusInfo(const string &name) const {
-  if (bus_responses_.count(name) != 0) {
-    return bus_responses_.at(name);
+  if (const auto bus_id = bus_names_.Find(name)) {
+    return bus_responses_[*bus_id];
   } else {
     return nullopt;
   }
 }
 
-optional<const Responses::Route>
+shared_ptr<const Responses::Route>
 Database::FindRoute(const string &stop_from, const string &stop_to) const {
-  return router_->FindRoute(stop_from, stop_to);
-}
-
-int Database::ComputeRoadRouteLength(
-    const vector<string> &stops,
-    const TransportData::StopsDict &stops_dict
-) {
-  int result = 0;
-  for (size_t i = 1; i < stops.size(); ++i) {
-    result += TransportData::ComputeAdjacentStopsDistance(stops_dict.at(stops[i - 1]), stops_dict.at(stops[i]));
+  const auto stop_id_from = FindStopId(stop_from);
+  const auto stop_id_to = FindStopId(stop_to);
+  if (!stop_id_from || !stop_id_to) {
+    throw out_of_range("unknown stop " + (stop_id_from ? stop_to : stop_from));
   }
-  return result;
+  const RouteKey key = static_cast<RouteKey>(*stop_id_from) << 32 | *stop_id_to;
+  if (auto route = route_cache_->Find(key)) {
+    Profiler::AddCount("route_cache_hits", 1);
+    return move(*route);
+  }
+  Profiler::AddCount("route_cache_misses", 1);
+  shared_ptr<const Responses::Route> route;
+  if (auto found_route = GetRouter().FindRoute(*stop_id_from, *stop_id_to)) {
+    route = make_shared<const Responses::Route>(move(*found_route));
+  }
+  route_cache_->Put(key, route);
+  return route;
 }
 
-double Database::ComputeGeoRouteDistance(
-    const vector<string> &stops,
-    const TransportData::StopsDict &stops_dict
-) {
+double Database::ComputeGeoRouteDistance(const vector<TransportData::StopId> &stops, const TransportData::Data &data) {
   double result = 0;
   for (size_t i = 1; i < stops.size(); ++i) {
-    result += Location::Distance(stops_dict.at(stops[i - 1]).position, stops_dict.at(stops[i]).position);
+    result += Location::Distance(data.stops[stops[i - 1]].position, data.stops[stops[i]].position);
   }
   return result;
 }
+
+void Database::Serialize(ostream &output) const {
+  Serialization::Write(output, stop_names_);
+  Serialization::Write(output, stop_positions_);
+  Serialization::Write(output, stop_bus_ids_);
+  Serialization::Write(output, bus_names_);
+  Serialization::Write(output, bus_responses_);
+  Serialization::Write(output, bus_is_roundtrip_);
+  Serialization::Write(output, bus_stop_ids_);
+  GetRouter().Serialize(output);
+}
+
+Database Database::Deserialize(istream &input) {
+  Database db;
+  Serialization::Read(input, db.stop_names_);
+  Serialization::Read(input, db.stop_positions_);
+  Serialization::Read(input, db.stop_bus_ids_);
+  Serialization::Read(input, db.bus_names_);
+  Serialization::Read(input, db.bus_responses_);
+  Serialization::Read(input, db.bus_is_roundtrip_);
+  Serialization::Read(input, db.bus_stop_ids_);
+  db.router_ = TransportRouter::Deserialize(input);
+  return db;
+}
 }
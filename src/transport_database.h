@@ -1,47 +1,91 @@
 #pragma once
 
 #include "utils.h"
+#include "flat_array.h"
+#include "lru_cache.h"
 #include "json.h"
 #include "transport_data.h"
 #include "transport_router.h"
 #include "responses.h"
 
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <optional>
-#include <set>
 #include <string>
-#include <unordered_map>
-#include <variant>
+#include <string_view>
 #include <vector>
 
 namespace TransportDatabase {
 class Database {
  public:
-  Database(std::vector<TransportData::DataQuery> data, const Json::Dict &routing_settings);
+  // With several threads, bus statistics are computed in parallel and the router is built in the background:
+  // requests that don't need it, and e.g. map rendering, don't wait for it
+  Database(TransportData::Data data, const Json::Dict &routing_settings, size_t thread_count = 1);
 
-  [[nodiscard]] const TransportData::StopsDict &GetStopsData() const { return stops_data_; }
-  [[nodiscard]] const TransportData::BusesDict &GetBusesData() const { return buses_data_; }
+  [[nodiscard]] size_t GetStopCount() const { return stop_names_.size(); }
+  [[nodiscard]] std::string_view GetStopName(TransportData::StopId stop_id) const { return stop_names_[stop_id]; }
+  [[nodiscard]] Location::Point GetStopPosition(TransportData::StopId stop_id) const {
+    return stop_positions_[stop_id];
+  }
+  [[nodiscard]] Range<const TransportData::BusId *> GetStopBusIds(TransportData::StopId stop_id) const {
+    return stop_bus_ids_[stop_id];
+  }
+
+  [[nodiscard]] size_t GetBusCount() const { return bus_names_.size(); }
+  [[nodiscard]] std::string_view GetBusName(TransportData::BusId bus_id) const { return bus_names_[bus_id]; }
+  [[nodiscard]] bool IsRoundtrip(TransportData::BusId bus_id) const { return bus_is_roundtrip_[bus_id] != 0; }
+  [[nodiscard]] Range<const TransportData::StopId *> GetBusStopIds(TransportData::BusId bus_id) const {
+    return bus_stop_ids_[bus_id];
+  }
+
+  [[nodiscard]] std::optional<TransportData::StopId> FindStopId(std::string_view name) const;
+  [[nodiscard]] std::optional<TransportData::BusId> FindBusId(std::string_view name) const;
 
   [[nodiscard]] std::optional<const Responses::Stop> GetStopInfo(const std::string &name) const;
   [[nodiscard]] std::optional<const Responses::Bus> GetBusInfo(const std::string &name) const;
 
-  [[nodiscard]]
-  std::optional<const Responses::Route> FindRoute(const std::string &stop_from, const std::string &stop_to) const;
+  // routes between this many pairs of stops last asked for are kept
+  static constexpr size_t ROUTE_CACHE_SIZE = 4096;
+
+  // nullptr if there is no route; recently found routes, and their absence, are cached and shared
+  [[nodiscard]] std::shared_ptr<const Responses::Route> FindRoute(const std::string &stop_from,
+                                                                  const std::string &stop_to) const;
+
+  // Everything is answered from flat tables only, so a database read from a mapped snapshot
+  // answers requests in place
+  void Serialize(std::ostream &output) const;
+  static Database Deserialize(std::istream &input);
 
  private:
-  static int ComputeRoadRouteLength(
-      const std::vector<std::string> &stops,
-      const TransportData::StopsDict &stops_dict
-  );
-
-  static double ComputeGeoRouteDistance(
-      const std::vector<std::string> &stops,
-      const TransportData::StopsDict &stops_dict
-  );
-
-  TransportData::StopsDict stops_data_{};
-  TransportData::BusesDict buses_data_{};
-  std::unordered_map<std::string, Responses::Stop> stop_responses_{};
-  std::unordered_map<std::string, Responses::Bus> bus_responses_{};
-  std::unique_ptr<TransportRouter> router_ = nullptr;
+  static const size_t BUSES_PER_CHUNK = 64;
+
+  // stop ids from and to in the high and the low half
+  using RouteKey = uint64_t;
+  using RouteCache = LruCache<RouteKey, std::shared_ptr<const Responses::Route>>;
+
+  Database() = default;
+
+  void BuildTables(const TransportData::Data &data, size_t thread_count);
+  const TransportRouter &GetRouter() const;
+
+  static double ComputeGeoRouteDistance(const std::vector<TransportData::StopId> &stops,
+                                        const TransportData::Data &data);
+
+  // stop and bus ids are positions of their names in the sorted name tables
+  StringTable stop_names_{};
+  FlatArray<Location::Point> stop_positions_{};
+  FlatLists<TransportData::BusId> stop_bus_ids_{};
+  StringTable bus_names_{};
+  FlatArray<Responses::Bus> bus_responses_{};
+  FlatArray<uint8_t> bus_is_roundtrip_{};
+  FlatLists<TransportData::StopId> bus_stop_ids_{};
+  mutable std::unique_ptr<TransportRouter> router_ = nullptr;
+  mutable std::future<std::unique_ptr<TransportRouter>> pending_router_{};
+  mutable std::exception_ptr router_error_ = nullptr;
+  std::unique_ptr<std::once_flag> router_ready_ = std::make_unique<std::once_flag>();
+  std::unique_ptr<RouteCache> route_cache_ = std::make_unique<RouteCache>(ROUTE_CACHE_SIZE);
 };
 }
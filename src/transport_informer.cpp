@@ -1,117 +1,350 @@
 #include "transport_informer.h"
 #include "transport_router.h"
+#include "parallel.h"
+#include "profiler.h"
 
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 using namespace std;
 
 namespace Requests {
 
-  Json::Dict Stop::Process(const TransportDatabase &db) const {
+  static void WriteNotFound(Json::Handler &output) {
+    output.Key("error_message");
+    output.String("not found");
+  }
+
+  void Stop::Process(const TransportDatabase &db, const MapBuilder *, Json::Handler &output) const {
     const auto stop = db.GetStopInfo(name);
-    Json::Dict response;
     if (!stop) {
-      response["error_message"] = Json::Node("not found"s);
-    } else {
-      vector<Json::Node> bus_nodes;
-      bus_nodes.reserve(stop->bus_names.size());
-      for (const auto& bus_name : stop->bus_names) {
-        bus_nodes.emplace_back(bus_name);
-      }
-      response["buses"] = Json::Node(move(bus_nodes));
+      WriteNotFound(output);
+      return;
+    }
+    output.Key("buses");
+    output.StartArray();
+    for (const auto& bus_name : stop->bus_names) {
+      output.String(bus_name);
     }
-    return response;
+    output.EndArray();
   }
 
-  Json::Dict Bus::Process(const TransportDatabase &db) const {
+  void Bus::Process(const TransportDatabase &db, const MapBuilder *, Json::Handler &output) const {
     const auto bus = db.GetBusInfo(name);
-    Json::Dict response;
     if (!bus) {
-      response["error_message"] = Json::Node("not found"s);
-    } else {
-      response = {
-          {"stop_count", Json::Node(static_cast<int>(bus->stop_count))},
-          {"unique_stop_count", Json::Node(static_cast<int>(bus->unique_stop_count))},
-          {"route_length", Json::Node(bus->road_route_length)},
-          {"curvature", Json::Node(bus->road_route_length / bus->geo_route_length)},
-      };
-    }
-    return response;
-  }
-
-  struct RouteItemResponseBuilder {
-    Json::Dict operator()(const Responses::Route::BusItem &bus_item) const {
-      return Json::Dict{
-          {"type", Json::Node("Bus"s)},
-          {"bus", Json::Node(bus_item.bus_name)},
-          {"time", Json::Node(bus_item.time)},
-          {"span_count", Json::Node(static_cast<int>(bus_item.span_count))}
-      };
-    }
-    Json::Dict operator()(const Responses::Route::WaitItem &wait_item) const {
-      return Json::Dict{
-          {"type", Json::Node("Wait"s)},
-          {"stop_name", Json::Node(wait_item.stop_name)},
-          {"time", Json::Node(wait_item.time)},
-      };
+      WriteNotFound(output);
+      return;
+    }
+    output.Key("curvature");
+    output.Double(bus->road_route_length / bus->geo_route_length);
+    output.Key("route_length");
+    output.Int(bus->road_route_length);
+    output.Key("stop_count");
+    output.Int(static_cast<int>(bus->stop_count));
+    output.Key("unique_stop_count");
+    output.Int(static_cast<int>(bus->unique_stop_count));
+  }
+
+  struct RouteItemResponseWriter {
+    Json::Handler &output;
+
+    void operator()(const Responses::Route::BusItem &bus_item) const {
+      output.Key("bus");
+      output.String(bus_item.bus_name);
+      output.Key("span_count");
+      output.Int(static_cast<int>(bus_item.span_count));
+      output.Key("time");
+      output.Double(bus_item.time);
+      output.Key("type");
+      output.String("Bus");
+    }
+    void operator()(const Responses::Route::WaitItem &wait_item) const {
+      output.Key("stop_name");
+      output.String(wait_item.stop_name);
+      output.Key("time");
+      output.Double(wait_item.time);
+      output.Key("type");
+      output.String("Wait");
     }
   };
 
-  Json::Dict Route::Process(const TransportDatabase &db) const {
-    Json::Dict response;
+  static void WriteRoute(const Responses::Route &route, Json::Handler &output) {
+    output.Key("items");
+    output.StartArray();
+    for (const auto& item : route.items) {
+      output.StartDict();
+      visit(RouteItemResponseWriter{output}, item);
+      output.EndDict();
+    }
+    output.EndArray();
+    output.Key("total_time");
+    output.Double(route.total_time);
+  }
+
+  void Route::Process(const TransportDatabase &db, const MapBuilder *, Json::Handler &output) const {
     const auto route = db.FindRoute(stop_from, stop_to);
     if (!route) {
-      response["error_message"] = Json::Node("not found"s);
-    } else {
-      response["total_time"] = Json::Node(route->total_time);
-      vector<Json::Node> items;
-      items.reserve(route->items.size());
-      for (const auto& item : route->items) {
-        items.emplace_back(visit(RouteItemResponseBuilder{}, item));
+      WriteNotFound(output);
+      return;
+    }
+    WriteRoute(*route, output);
+  }
+
+  void RouteMap::Process(const TransportDatabase &db, const MapBuilder *map_builder, Json::Handler &output) const {
+    const auto route = db.FindRoute(stop_from, stop_to);
+    if (!route) {
+      WriteNotFound(output);
+      return;
+    }
+    WriteRoute(*route, output);
+    output.Key("map");
+    output.String(map_builder->RenderRoute(*route, stop_to));
+  }
+
+  void Map::Process(const TransportDatabase &db, const MapBuilder *map_builder, Json::Handler &output) const {
+    output.Key("map");
+    output.String(map_builder->GetMap());
+  }
+
+  void MapTile::Process(const TransportDatabase &db, const MapBuilder *map_builder, Json::Handler &output) const {
+    const auto map_tile = map_builder->GetTile(tile);
+    if (!map_tile) {
+      WriteNotFound(output);
+      return;
+    }
+    output.Key("map");
+    output.String(*map_tile);
+  }
+
+  void StatRequestsBuilder::Add(const Json::Dict &info) {
+    StartDict();
+    for (const auto &[key, value] : info) {
+      Key(key);
+      Json::WriteNode(value, *this);
+    }
+    EndDict();
+  }
+
+  vector<StatRequest> StatRequestsBuilder::Build() && {
+    return move(requests_);
+  }
+
+  void StatRequestsBuilder::StartArray() {
+    ++depth_;
+  }
+
+  void StatRequestsBuilder::EndArray() {
+    --depth_;
+  }
+
+  void StatRequestsBuilder::StartDict() {
+    if (++depth_ == 1) {
+      fields_ = {};
+      field_ = Field::Other;
+    }
+  }
+
+  void StatRequestsBuilder::EndDict() {
+    if (depth_-- == 1) {
+      FinishRequest();
+    }
+  }
+
+  void StatRequestsBuilder::Key(string_view key) {
+    if (depth_ != 1) {
+      return;
+    }
+    static const pair<string_view, Field> FIELDS[] = {
+        {"id", Field::Id}, {"type", Field::Type}, {"name", Field::Name}, {"from", Field::From},
+        {"to", Field::To}, {"zoom", Field::Zoom}, {"x", Field::X}, {"y", Field::Y},
+    };
+    field_ = Field::Other;
+    for (const auto &[name, field] : FIELDS) {
+      if (key == name) {
+        field_ = field;
       }
+    }
+  }
 
-      response["items"] = move(items);
+  void StatRequestsBuilder::String(string_view value) {
+    if (depth_ != 1) {
+      return;
     }
+    switch (field_) {
+      case Field::Type:
+        fields_.type = value;
+        break;
+      case Field::Name:
+        fields_.name.emplace(value);
+        break;
+      case Field::From:
+        fields_.from.emplace(value);
+        break;
+      case Field::To:
+        fields_.to.emplace(value);
+        break;
+      default:
+        break;
+    }
+  }
 
-    return response;
+  void StatRequestsBuilder::Int(int value) {
+    if (depth_ != 1) {
+      return;
+    }
+    switch (field_) {
+      case Field::Id:
+        fields_.id = value;
+        break;
+      case Field::Zoom:
+        fields_.zoom = value;
+        break;
+      case Field::X:
+        fields_.x = value;
+        break;
+      case Field::Y:
+        fields_.y = value;
+        break;
+      default:
+        break;
+    }
+  }
+
+  void StatRequestsBuilder::FinishRequest() {
+    if (!fields_.id) {
+      throw runtime_error("request without id");
+    }
+    requests_.push_back({*fields_.id, MakeRequest()});
+  }
+
+  Request StatRequestsBuilder::MakeRequest() {
+    const string &type = fields_.type;
+    const auto take = [&type](optional<string> &field, const char *name) {
+      if (!field) {
+        throw runtime_error(type + " request without " + name);
+      }
+      return move(*field);
+    };
+    const auto get_coordinate = [&type](const optional<int> &field, const char *name) {
+      if (!field) {
+        throw runtime_error(type + " request without " + name);
+      }
+      return static_cast<uint32_t>(*field);
+    };
+    if (type == "Bus") {
+      return Bus{take(fields_.name, "name")};
+    } else if (type == "Stop") {
+      return Stop{take(fields_.name, "name")};
+    } else if (type == "Route") {
+      return Route{take(fields_.from, "from"), take(fields_.to, "to")};
+    } else if (type == "RouteMap") {
+      return RouteMap{take(fields_.from, "from"), take(fields_.to, "to")};
+    } else if (type == "Map") {
+      return Map{};
+    } else if (type == "MapTile") {
+      return MapTile{{get_coordinate(fields_.zoom, "zoom"), get_coordinate(fields_.x, "x"), get_coordinate(fields_.y, "y")}};
+    } else {
+      throw runtime_error("unknown request type");
+    }
   }
 
-  Json::Dict Map::Process(const TransportDatabase &db) const {
-    Json::Dict response;
-    response["map"] = map_builder->GetMap();
-    return response;
+  vector<StatRequest> ReadStatRequests(const vector<Json::Node> &nodes) {
+    StatRequestsBuilder builder;
+    for (const Json::Node &node : nodes) {
+      builder.Add(node.AsMap());
+    }
+    return move(builder).Build();
   }
 }
 
 namespace TransportInformer {
 using namespace Requests;
 
-Request Informer::Read(const Json::Dict &attrs) {
-  const string &type = attrs.at("type").AsString();
-  if (type == "Bus") {
-    return Bus{attrs.at("name").AsString()};
-  } else if (type == "Stop") {
-    return Stop{attrs.at("name").AsString()};
-  } else if (type == "Route") {
-    return Route{attrs.at("from").AsString(), attrs.at("to").AsString()};
-  } else if (type == "Map") {
-    return Map{map_builder_};
-  } else {
-    throw runtime_error("unknown request type");
+void Informer::ProcessRequest(const TransportDatabase &db, const StatRequest &request, Json::Handler &output) const {
+  const auto start = Profiler::IsEnabled() ? optional(Profiler::Clock::now()) : nullopt;
+  output.StartDict();
+  output.Key("request_id");
+  output.Int(request.id);
+  visit([this, &db, &output](const auto &request) { request.Process(db, map_builder_.get(), output); }, request.request);
+  output.EndDict();
+  // latencies are collected by request type
+  if (start) {
+    Profiler::AddLatency(visit([](const auto &request) { return request.TYPE; }, request.request),
+                         Profiler::Clock::now() - *start);
   }
 }
 
-vector<Json::Node> Informer::ProcessRequests(const TransportDatabase &db, const vector<Json::Node> &requests) {
-  vector<Json::Node> responses;
-  responses.reserve(requests.size());
-  auto process_lambda = [&db](const auto &request) {
-    return request.Process(db);
-  };
-  for (const auto &request_info : requests) {
-    Json::Dict dict = visit(process_lambda, Read(request_info.AsMap()));
-    dict["request_id"] = Json::Node(request_info.AsMap().at("id").AsInt());
-    responses.emplace_back(dict);
-  }
+void Informer::ProcessRequest(const TransportDatabase &db, const Json::Dict &request_info,
+                              Json::Handler &output) const {
+  StatRequestsBuilder builder;
+  builder.Add(request_info);
+  ProcessRequest(db, move(builder).Build().front(), output);
+}
+
+vector<Json::Node> Informer::ProcessRequests(const TransportDatabase &db, const vector<Json::Node> &requests) const {
+  vector<Json::Node> responses(requests.size());
+  Parallel::RunInChunks(requests.size(), CHUNK_SIZE, thread_count_, [&](size_t begin, size_t end) {
+    for (size_t idx = begin; idx < end; ++idx) {
+      Json::TreeBuilder builder;
+      ProcessRequest(db, requests[idx].AsMap(), builder);
+      responses[idx] = builder.ExtractRoot();
+    }
+  });
   return responses;
 }
+
+void Informer::ProcessRequests(const TransportDatabase &db, const vector<Json::Node> &requests,
+                               Json::Writer &output) const {
+  ProcessRequests(db, ReadStatRequests(requests), output);
+}
+
+void Informer::ProcessRequests(const TransportDatabase &db, const vector<StatRequest> &requests,
+                               Json::Writer &output) const {
+  output.StartArray();
+  if (thread_count_ == 1) {
+    for (const StatRequest &request : requests) {
+      ProcessRequest(db, request, output);
+    }
+  } else {
+    // every chunk is serialized separately and written in the order of requests. The map is
+    // rendered once and shared, so Map requests are left out of chunks and written right to the
+    // output in their place, which escapes the document straight into it without copies.
+    struct SerializedChunk {
+      // parts of the chunk before, between and after its Map requests
+      vector<string> parts;
+      vector<size_t> map_requests;
+    };
+    vector<SerializedChunk> serialized_chunks((requests.size() + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    Parallel::RunInChunks(requests.size(), CHUNK_SIZE, thread_count_, [&](size_t begin, size_t end) {
+      SerializedChunk &chunk = serialized_chunks[begin / CHUNK_SIZE];
+      ostringstream part_output;
+      optional<Json::Writer> part_writer(in_place, part_output, output.GetPrecision());
+      for (size_t idx = begin; idx < end; ++idx) {
+        if (!holds_alternative<Map>(requests[idx].request)) {
+          ProcessRequest(db, requests[idx], *part_writer);
+          continue;
+        }
+        part_writer.reset();
+        chunk.parts.push_back(part_output.str());
+        chunk.map_requests.push_back(idx);
+        part_output.str({});
+        part_writer.emplace(part_output, output.GetPrecision());
+      }
+      part_writer.reset();
+      chunk.parts.push_back(part_output.str());
+    });
+    for (const SerializedChunk &chunk : serialized_chunks) {
+      for (size_t idx = 0; idx < chunk.map_requests.size(); ++idx) {
+        output.Raw(chunk.parts[idx]);
+        ProcessRequest(db, requests[chunk.map_requests[idx]], output);
+      }
+      output.Raw(chunk.parts.back());
+    }
+  }
+  output.EndArray();
+}
 }
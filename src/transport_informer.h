@@ -4,39 +4,115 @@
 #include "transport_database.h"
 #include "map_builder.h"
 
+#include <algorithm>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <variant>
+#include <vector>
 
 
+// Process writes the items of the response dict to the handler. Requests are read before the map
+// is built, so those about the map get it from the informer.
 namespace Requests {
 using TransportDatabase = TransportDatabase::Database;
+using MapBuilder = Visualisation::MapBuilder;
 
 struct Stop {
+  static constexpr std::string_view TYPE = "Stop";
   std::string name;
 
-  [[nodiscard]] Json::Dict Process(const TransportDatabase &db) const;
+  void Process(const TransportDatabase &db, const MapBuilder *map_builder, Json::Handler &output) const;
 };
 
 struct Bus {
+  static constexpr std::string_view TYPE = "Bus";
   std::string name;
 
-  [[nodiscard]] Json::Dict Process(const TransportDatabase &db) const;
+  void Process(const TransportDatabase &db, const MapBuilder *map_builder, Json::Handler &output) const;
 };
 
 struct Route {
+  static constexpr std::string_view TYPE = "Route";
   std::string stop_from;
   std::string stop_to;
 
-  [[nodiscard]] Json::Dict Process(const TransportDatabase &db) const;
+  void Process(const TransportDatabase &db, const MapBuilder *map_builder, Json::Handler &output) const;
+};
+
+// Route with its overlay for the map
+struct RouteMap {
+  static constexpr std::string_view TYPE = "RouteMap";
+  std::string stop_from;
+  std::string stop_to;
+
+  void Process(const TransportDatabase &db, const MapBuilder *map_builder, Json::Handler &output) const;
 };
 
 struct Map {
-  std::shared_ptr<Visualisation::MapBuilder> map_builder;
-  [[nodiscard]] Json::Dict Process(const TransportDatabase &db) const;
+  static constexpr std::string_view TYPE = "Map";
+
+  void Process(const TransportDatabase &db, const MapBuilder *map_builder, Json::Handler &output) const;
+};
+
+struct MapTile {
+  static constexpr std::string_view TYPE = "MapTile";
+  Visualisation::TileId tile;
+
+  void Process(const TransportDatabase &db, const MapBuilder *map_builder, Json::Handler &output) const;
+};
+
+using Request = std::variant<Stop, Bus, Route, RouteMap, Map, MapTile>;
+
+struct StatRequest {
+  int id;
+  Request request;
+};
+
+// Reads stat requests one by one, from dicts or from parsing events of the items of stat_requests,
+// which are read without building nodes
+class StatRequestsBuilder : public Json::Handler {
+ public:
+  void Add(const Json::Dict &info);
+  std::vector<StatRequest> Build() &&;
+
+  void StartArray() override;
+  void EndArray() override;
+  void StartDict() override;
+  void EndDict() override;
+  void Key(std::string_view key) override;
+  void String(std::string_view value) override;
+  void Int(int value) override;
+  void Double(double) override {}
+  void Bool(bool) override {}
+
+ private:
+  enum class Field { Other, Id, Type, Name, From, To, Zoom, X, Y };
+
+  // fields of the request being parsed
+  struct Fields {
+    std::optional<int> id;
+    std::string type;
+    std::optional<std::string> name;
+    std::optional<std::string> from;
+    std::optional<std::string> to;
+    std::optional<int> zoom;
+    std::optional<int> x;
+    std::optional<int> y;
+  };
+
+  void FinishRequest();
+  Request MakeRequest();
+
+  Fields fields_;
+  // of the containers open in the request
+  size_t depth_ = 0;
+  Field field_ = Field::Other;
+  std::vector<StatRequest> requests_;
 };
 
-using Request = std::variant<Stop, Bus, Route, Map>;
+std::vector<StatRequest> ReadStatRequests(const std::vector<Json::Node> &nodes);
 }
 
 namespace TransportInformer {
@@ -45,15 +121,24 @@ using TransportDatabase = TransportDatabase::Database;
 class Informer {
  public:
   Informer() = default;
-  explicit Informer(std::shared_ptr<Visualisation::MapBuilder> map_builder)
-    : map_builder_(std::move(map_builder)) {}
-  Requests::Request Read(const Json::Dict &attrs);
-  std::vector<Json::Node> ProcessRequests(const TransportDatabase &db, const std::vector<Json::Node> &requests);
+  // Requests are processed by chunks on thread_count threads, responses keep the order of requests
+  explicit Informer(std::shared_ptr<Visualisation::MapBuilder> map_builder, size_t thread_count = 1)
+    : map_builder_(std::move(map_builder)), thread_count_(std::max<size_t>(thread_count, 1)) {}
+  std::vector<Json::Node> ProcessRequests(const TransportDatabase &db, const std::vector<Json::Node> &requests) const;
+  // Writes the array of responses
+  void ProcessRequests(const TransportDatabase &db, const std::vector<Json::Node> &requests,
+                       Json::Writer &output) const;
+  void ProcessRequests(const TransportDatabase &db, const std::vector<Requests::StatRequest> &requests,
+                       Json::Writer &output) const;
+  // Writes the response dict of a single request
+  void ProcessRequest(const TransportDatabase &db, const Json::Dict &request_info, Json::Handler &output) const;
+  void ProcessRequest(const TransportDatabase &db, const Requests::StatRequest &request, Json::Handler &output) const;
 
  private:
+  static const size_t CHUNK_SIZE = 64;
+
   std::shared_ptr<Visualisation::MapBuilder> map_builder_;
+  size_t thread_count_ = 1;
 };
 
 }
-
-
@@ -1,109 +1,326 @@
 #include "transport_router.h"
+#include "serialization.h"
+#include "parallel.h"
+#include "profiler.h"
+
+#include <limits>
+#include <stdexcept>
 
 using namespace std;
 
 
-TransportRouter::TransportRouter(const TransportData::StopsDict &stops,
-                                 const TransportData::BusesDict &buses,
-                                 const Json::Dict &settings)
-    : routing_settings_(ParseRoutingSettings(settings))
+TransportRouter::TransportRouter(const TransportData::Data &data, const Json::Dict &settings, size_t thread_count)
+    : routing_settings_(ParseRoutingSettings(settings)),
+      stop_names_(data.stop_names),
+      bus_names_(data.bus_names)
 {
-  const size_t vertex_count = stops.size() * 2;
-  vertices_info_.resize(vertex_count);
-  graph_ = TransportGraph(vertex_count);
+  {
+    Profiler::ScopedTimer timer("router.graph");
+    GraphArrays graph(CountOutgoingEdges(data));
+    FillGraphWithStops(graph);
+    switch (routing_settings_.graph_model) {
+      case GraphModel::StopPairs:
+        FillGraphWithBuses(data, thread_count, graph);
+        break;
+      case GraphModel::BusChains:
+        FillGraphWithBusChains(data, graph);
+        break;
+    }
+    graph_ = TransportGraph(move(graph.offsets), move(graph.sources), move(graph.targets), move(graph.weights));
+    edges_info_ = move(graph.edges_info);
+  }
+  Profiler::AddCount("graph_vertices", graph_.GetVertexCount());
+  Profiler::AddCount("graph_edges", graph_.GetEdgeCount());
 
-  FillGraphWithStops(stops);
-  FillGraphWithBuses(stops, buses);
+  Profiler::ScopedTimer timer("router.preprocess");
+  router_ = MakeRouter();
+}
 
-  router_ = std::make_unique<Router>(graph_);
+void TransportRouter::CheckSettings(const Json::Dict &settings) {
+  ParseRoutingSettings(settings);
 }
 
 TransportRouter::RoutingSettings TransportRouter::ParseRoutingSettings(const Json::Dict &description) {
   return {
       description.at("bus_wait_time").AsInt(),
       description.at("bus_velocity").AsDouble(),
+      ParseRoutingAlgorithm(description),
+      ParseGraphModel(description),
   };
 }
 
-void TransportRouter::FillGraphWithStops(const TransportData::StopsDict &stops) {
-  Graph::VertexId vertex_id = 0;
+TransportRouter::RoutingAlgorithm TransportRouter::ParseRoutingAlgorithm(const Json::Dict &description) {
+  if (description.count("routing_algorithm") == 0) {
+    return RoutingAlgorithm::FloydWarshall;
+  }
+  const string &algorithm = description.at("routing_algorithm").AsString();
+  if (algorithm == "floyd_warshall") {
+    return RoutingAlgorithm::FloydWarshall;
+  } else if (algorithm == "dijkstra") {
+    return RoutingAlgorithm::Dijkstra;
+  } else if (algorithm == "contraction_hierarchies") {
+    return RoutingAlgorithm::ContractionHierarchies;
+  } else {
+    throw runtime_error("unknown routing algorithm");
+  }
+}
+
+TransportRouter::GraphModel TransportRouter::ParseGraphModel(const Json::Dict &description) {
+  if (description.count("graph_model") == 0) {
+    return GraphModel::StopPairs;
+  }
+  const string &graph_model = description.at("graph_model").AsString();
+  if (graph_model == "stop_pairs") {
+    return GraphModel::StopPairs;
+  } else if (graph_model == "bus_chains") {
+    return GraphModel::BusChains;
+  } else {
+    throw runtime_error("unknown graph model");
+  }
+}
+
+vector<size_t> TransportRouter::CountOutgoingEdges(const TransportData::Data &data) const {
+  vector<size_t> out_degrees(data.stops.size() * 2);
+  for (TransportData::StopId stop_id = 0; stop_id < data.stops.size(); ++stop_id) {
+    ++out_degrees[GetStopVertexIds(stop_id).wait_on_stop];
+  }
+  for (const TransportData::Bus &bus : data.buses) {
+    const size_t stop_count = bus.stops.size();
+    for (size_t stop_idx = 0; stop_idx < stop_count; ++stop_idx) {
+      const Graph::VertexId depart_vertex = GetStopVertexIds(bus.stops[stop_idx]).depart_from_stop;
+      switch (routing_settings_.graph_model) {
+        case GraphModel::StopPairs:
+          out_degrees[depart_vertex] += stop_count - 1 - stop_idx;
+          break;
+        case GraphModel::BusChains:
+          // boarding at the stop, and leaving the bus and riding on from its on-board vertex
+          out_degrees[depart_vertex] += stop_idx + 1 < stop_count;
+          out_degrees.push_back((stop_idx > 0) + (stop_idx + 1 < stop_count));
+          break;
+      }
+    }
+  }
+  return out_degrees;
+}
+
+double TransportRouter::ComputeRideTime(int distance) const {
+  return distance * 1.0 / (routing_settings_.bus_velocity * 1000.0 / 60);  // m / (km/h * 1000 / 60) = min
+}
+
+unique_ptr<TransportRouter::Router> TransportRouter::MakeRouter() const {
+  switch (routing_settings_.algorithm) {
+    case RoutingAlgorithm::FloydWarshall:
+      return make_unique<Graph::FloydWarshallRouter<double>>(graph_);
+    case RoutingAlgorithm::Dijkstra:
+      return make_unique<Graph::DijkstraRouter<double>>(graph_);
+    case RoutingAlgorithm::ContractionHierarchies:
+      return make_unique<Graph::ContractionHierarchiesRouter<double>>(graph_);
+  }
+  throw runtime_error("unknown routing algorithm");
+}
+
+unique_ptr<TransportRouter::Router> TransportRouter::MakeRouter(istream &input) const {
+  switch (routing_settings_.algorithm) {
+    case RoutingAlgorithm::FloydWarshall:
+      return make_unique<Graph::FloydWarshallRouter<double>>(graph_, input);
+    case RoutingAlgorithm::Dijkstra:
+      return make_unique<Graph::DijkstraRouter<double>>(graph_, input);
+    case RoutingAlgorithm::ContractionHierarchies:
+      return make_unique<Graph::ContractionHierarchiesRouter<double>>(graph_, input);
+  }
+  throw runtime_error("unknown routing algorithm");
+}
+
+TransportData::StopId TransportRouter::GetStopId(const string &stop_name) const {
+  if (const auto stop_id = stop_names_.Find(stop_name)) {
+    return static_cast<TransportData::StopId>(*stop_id);
+  }
+  throw out_of_range("unknown stop " + stop_name);
+}
+
+TransportRouter::GraphArrays::GraphArrays(const vector<size_t> &out_degrees) {
+  offsets.reserve(out_degrees.size() + 1);
+  offsets.push_back(0);
+  size_t edge_count = 0;
+  for (const size_t out_degree : out_degrees) {
+    edge_count += out_degree;
+    if (edge_count >= numeric_limits<TransportGraph::CompactId>::max()) {
+      throw length_error("graph is too large for 32-bit ids");
+    }
+    offsets.push_back(static_cast<TransportGraph::CompactId>(edge_count));
+  }
+  free_slots.assign(offsets.begin(), offsets.end() - 1);
+  sources.resize(edge_count);
+  targets.resize(edge_count);
+  weights.resize(edge_count);
+  edges_info.resize(edge_count);
+}
 
-  for (const auto &[stop_name, _] : stops) {
-    auto &vertex_ids = stops_vertex_ids_[stop_name];
-    vertex_ids.wait_on_stop = vertex_id++;
-    vertex_ids.depart_from_stop = vertex_id++;
-    vertices_info_[vertex_ids.wait_on_stop] = {stop_name};
-    vertices_info_[vertex_ids.depart_from_stop] = {stop_name};
+size_t TransportRouter::GraphArrays::TakeSlots(Graph::VertexId from, size_t count) {
+  const size_t slot = free_slots[from];
+  free_slots[from] += count;
+  return slot;
+}
+
+void TransportRouter::GraphArrays::SetEdge(size_t slot, const Graph::Edge<double> &edge, EdgeInfo edge_info) {
+  sources[slot] = static_cast<TransportGraph::CompactId>(edge.from);
+  targets[slot] = static_cast<TransportGraph::CompactId>(edge.to);
+  weights[slot] = edge.weight;
+  edges_info[slot] = edge_info;
+}
 
-    edges_info_.emplace_back(WaitEdgeInfo{});
-    graph_.AddEdge({
+void TransportRouter::FillGraphWithStops(GraphArrays &graph) const {
+  for (TransportData::StopId stop_id = 0; stop_id < stop_names_.size(); ++stop_id) {
+    const StopVertexIds vertex_ids = GetStopVertexIds(stop_id);
+    graph.AddEdge({
         vertex_ids.wait_on_stop,
         vertex_ids.depart_from_stop,
         static_cast<double>(routing_settings_.bus_wait_time)
-    });
+    }, {EdgeType::Wait, 0, 0});
   }
 }
 
-void TransportRouter::FillGraphWithBuses(const TransportData::StopsDict &stops,
-                                         const TransportData::BusesDict &buses) {
-  for (const auto &[_, current_bus] : buses) {
-    const size_t stop_count = current_bus.stops.size();
-    if (stop_count <= 1) {
-      continue;
+void TransportRouter::FillGraphWithBuses(const TransportData::Data &data, size_t thread_count,
+                                         GraphArrays &graph) const {
+  // a bus gets an edge for every pair of its stops. The edges from a stop of the bus take the next
+  // slots of the stop's departure vertex, so the slots are taken in order first, and then buses
+  // write their edges right into the graph independently.
+  vector<size_t> first_slot_offsets{0};
+  first_slot_offsets.reserve(data.buses.size() + 1);
+  vector<size_t> first_slots;
+  for (const TransportData::Bus &bus : data.buses) {
+    const size_t stop_count = bus.stops.size();
+    for (size_t start_idx = 0; start_idx + 1 < stop_count; ++start_idx) {
+      const Graph::VertexId start_vertex = GetStopVertexIds(bus.stops[start_idx]).depart_from_stop;
+      first_slots.push_back(graph.TakeSlots(start_vertex, stop_count - 1 - start_idx));
     }
+    first_slot_offsets.push_back(first_slots.size());
+  }
 
-    for (size_t start_idx = 0; start_idx < stop_count - 1; ++start_idx) {
-      const string &start_stop_name = current_bus.stops[start_idx];
-      const Graph::VertexId start_vertex = stops_vertex_ids_[start_stop_name].depart_from_stop;
-      int total_distance = 0;
-      for (size_t finish_idx = start_idx + 1; finish_idx < stop_count; ++finish_idx) {
-        const string &finish_stop_name = current_bus.stops[finish_idx];
-        total_distance += TransportData::ComputeAdjacentStopsDistance(stops.at(current_bus.stops[finish_idx - 1]),
-                                                                      stops.at(finish_stop_name));
-        edges_info_.emplace_back(BusEdgeInfo{
-            .bus_name = current_bus.name,
-            .span_count = finish_idx - start_idx,
-        });
-        graph_.AddEdge({
-            start_vertex,
-            stops_vertex_ids_[finish_stop_name].wait_on_stop,
-            total_distance * 1.0 / (routing_settings_.bus_velocity * 1000.0 / 60)  // m / (km/h * 1000 / 60) = min
-        });
+  // buses differ a lot in size, so every bus is a chunk of its own
+  Parallel::RunInChunks(data.buses.size(), 1, thread_count, [&](size_t begin, size_t end) {
+    for (TransportData::BusId bus_id = begin; bus_id < end; ++bus_id) {
+      const TransportData::Bus &bus = data.buses[bus_id];
+      const vector<TransportData::StopId> &stop_ids = bus.stops;
+      const size_t stop_count = stop_ids.size();
+      for (size_t start_idx = 0; start_idx + 1 < stop_count; ++start_idx) {
+        const Graph::VertexId start_vertex = GetStopVertexIds(stop_ids[start_idx]).depart_from_stop;
+        size_t slot = first_slots[first_slot_offsets[bus_id] + start_idx];
+        for (size_t finish_idx = start_idx + 1; finish_idx < stop_count; ++finish_idx) {
+          graph.SetEdge(slot++, {
+              start_vertex,
+              GetStopVertexIds(stop_ids[finish_idx]).wait_on_stop,
+              ComputeRideTime(bus.distances[finish_idx] - bus.distances[start_idx])
+          }, {
+              EdgeType::Bus,
+              bus_id,
+              static_cast<uint32_t>(finish_idx - start_idx),
+          });
+        }
+      }
+    }
+  });
+}
+
+void TransportRouter::FillGraphWithBusChains(const TransportData::Data &data, GraphArrays &graph) const {
+  Graph::VertexId vertex_id = stop_names_.size() * 2;
+
+  for (TransportData::BusId bus_id = 0; bus_id < data.buses.size(); ++bus_id) {
+    const TransportData::Bus &bus = data.buses[bus_id];
+    const vector<TransportData::StopId> &stop_ids = bus.stops;
+    const size_t stop_count = stop_ids.size();
+    const Graph::VertexId first_on_board_vertex = vertex_id;
+    for (size_t stop_idx = 0; stop_idx < stop_count; ++stop_idx) {
+      const StopVertexIds stop_vertex_ids = GetStopVertexIds(stop_ids[stop_idx]);
+      const Graph::VertexId on_board_vertex = vertex_id++;
+
+      // nobody boards at the final stop and nobody leaves at the first one
+      if (stop_idx + 1 < stop_count) {
+        graph.AddEdge({stop_vertex_ids.depart_from_stop, on_board_vertex, 0}, {EdgeType::Board, bus_id, 0});
+      }
+      if (stop_idx > 0) {
+        graph.AddEdge({on_board_vertex, stop_vertex_ids.wait_on_stop, 0}, {EdgeType::Alight, 0, 0});
+
+        const int distance = bus.distances[stop_idx] - bus.distances[stop_idx - 1];
+        graph.AddEdge({first_on_board_vertex + stop_idx - 1, on_board_vertex, ComputeRideTime(distance)},
+                      {EdgeType::Ride, 0, 0});
       }
     }
   }
 }
 
 optional<Responses::Route> TransportRouter::FindRoute(const string &stop_from, const string &stop_to) const {
-  const Graph::VertexId vertex_from = stops_vertex_ids_.at(stop_from).wait_on_stop;
-  const Graph::VertexId vertex_to = stops_vertex_ids_.at(stop_to).wait_on_stop;
-  const auto route = router_->BuildRoute(vertex_from, vertex_to);
-  if (!route) {
+  return FindRoute(GetStopId(stop_from), GetStopId(stop_to));
+}
+
+optional<Responses::Route> TransportRouter::FindRoute(TransportData::StopId stop_from,
+                                                      TransportData::StopId stop_to) const {
+  const Graph::VertexId vertex_from = GetStopVertexIds(stop_from).wait_on_stop;
+  const Graph::VertexId vertex_to = GetStopVertexIds(stop_to).wait_on_stop;
+  // every thread keeps its own route buffer, so queries don't allocate once it has grown
+  thread_local Graph::Router<double>::ExpandedRoute route_edges;
+  const auto total_time = router_->BuildRoute(vertex_from, vertex_to, route_edges);
+  if (!total_time) {
     return nullopt;
   }
 
-  Responses::Route route_info = {.total_time = route->weight};
-  route_info.items.reserve(route->edge_count);
-  for (size_t edge_idx = 0; edge_idx < route->edge_count; ++edge_idx) {
-    const Graph::EdgeId edge_id = router_->GetRouteEdge(route->id, edge_idx);
-    const auto &edge = graph_.GetEdge(edge_id);
-    const auto &edge_info = edges_info_[edge_id];
-    if (holds_alternative<BusEdgeInfo>(edge_info)) {
-      const auto &bus_edge_info = get<BusEdgeInfo>(edge_info);
-      route_info.items.emplace_back(Responses::Route::BusItem{
-          .bus_name = bus_edge_info.bus_name,
-          .time = edge.weight,
-          .span_count = bus_edge_info.span_count,
-      });
-    } else {
-      const Graph::VertexId vertex_id = edge.from;
-      route_info.items.emplace_back(Responses::Route::WaitItem{
-          .stop_name = vertices_info_[vertex_id].stop_name,
-          .time = edge.weight,
-      });
+  Responses::Route route_info = {.total_time = *total_time};
+  route_info.items.reserve(route_edges.size());
+  for (const Graph::EdgeId edge_id : route_edges) {
+    const auto edge = graph_.GetEdge(edge_id);
+    const EdgeInfo &edge_info = edges_info_[edge_id];
+    switch (edge_info.type) {
+      case EdgeType::Bus:
+        route_info.items.emplace_back(Responses::Route::BusItem{
+            .bus_name = string(bus_names_[edge_info.bus_id]),
+            .time = edge.weight,
+            .span_count = edge_info.span_count,
+        });
+        break;
+      case EdgeType::Board:
+        route_info.items.emplace_back(Responses::Route::BusItem{
+            .bus_name = string(bus_names_[edge_info.bus_id]),
+            .time = 0,
+            .span_count = 0,
+        });
+        break;
+      case EdgeType::Ride: {
+        auto &bus_item = get<Responses::Route::BusItem>(route_info.items.back());
+        bus_item.time += edge.weight;
+        ++bus_item.span_count;
+        break;
+      }
+      case EdgeType::Alight:
+        break;
+      case EdgeType::Wait:
+        // wait edges start at the wait vertex of their stop
+        route_info.items.emplace_back(Responses::Route::WaitItem{
+            .stop_name = string(stop_names_[edge.from / 2]),
+            .time = edge.weight,
+        });
+        break;
     }
   }
 
-  router_->ReleaseRoute(route->id);
   return route_info;
 }
+
+void TransportRouter::Serialize(ostream &output) const {
+  Serialization::Write(output, routing_settings_);
+  graph_.Serialize(output);
+  router_->Serialize(output);
+  Serialization::Write(output, stop_names_);
+  Serialization::Write(output, bus_names_);
+  Serialization::Write(output, edges_info_);
+}
+
+unique_ptr<TransportRouter> TransportRouter::Deserialize(istream &input) {
+  unique_ptr<TransportRouter> transport_router(new TransportRouter);
+  Serialization::Read(input, transport_router->routing_settings_);
+  transport_router->graph_ = TransportGraph::Deserialize(input);
+  transport_router->router_ = transport_router->MakeRouter(input);
+  Serialization::Read(input, transport_router->stop_names_);
+  Serialization::Read(input, transport_router->bus_names_);
+  Serialization::Read(input, transport_router->edges_info_);
+  return transport_router;
+}
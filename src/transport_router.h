@@ -1,59 +1,121 @@
 #pragma once
 
 #include "transport_data.h"
+#include "flat_array.h"
 #include "graph.h"
 #include "json.h"
 #include "router.h"
+#include "dijkstra_router.h"
+#include "contraction_hierarchies_router.h"
 #include "responses.h"
 
+#include <cstdint>
 #include <memory>
-#include <unordered_map>
 #include <vector>
 
 class TransportRouter {
 private:
-  using TransportGraph = Graph::DirectedWeightedGraph<double>;
+  using TransportGraph = Graph::CompressedDirectedWeightedGraph<double>;
   using Router = Graph::Router<double>;
 
 public:
-  TransportRouter(const TransportData::StopsDict &stops,
-                  const TransportData::BusesDict &buses,
-                  const Json::Dict &settings);
+  // Bus edges of the stop pairs graph are generated on thread_count threads
+  TransportRouter(const TransportData::Data &data, const Json::Dict &settings, size_t thread_count = 1);
+  // Throws on settings the constructor would reject, without building anything
+  static void CheckSettings(const Json::Dict &settings);
 
   std::optional<Responses::Route> FindRoute(const std::string &stop_from, const std::string &stop_to) const;
+  std::optional<Responses::Route> FindRoute(TransportData::StopId stop_from, TransportData::StopId stop_to) const;
+
+  void Serialize(std::ostream &output) const;
+  static std::unique_ptr<TransportRouter> Deserialize(std::istream &input);
 
 private:
+  TransportRouter() = default;
+
+  enum class RoutingAlgorithm {
+    FloydWarshall,
+    Dijkstra,
+    ContractionHierarchies,
+  };
+
+  // How riding a bus is represented in the graph
+  enum class GraphModel {
+    StopPairs,  // an edge from every stop to every later stop of the bus: sum of n^2 edges
+    BusChains,  // a chain of on-board vertices per bus, boarded and left at stops: sum of n edges
+  };
+
   struct RoutingSettings {
     int bus_wait_time;  // minutes
     double bus_velocity;  // km/h
+    RoutingAlgorithm algorithm;
+    GraphModel graph_model;
   };
 
   static RoutingSettings ParseRoutingSettings(const Json::Dict &description);
+  static RoutingAlgorithm ParseRoutingAlgorithm(const Json::Dict &description);
+  static GraphModel ParseGraphModel(const Json::Dict &description);
 
-  void FillGraphWithStops(const TransportData::StopsDict &stops);
+  // Number of the edges out of every vertex of the graph
+  std::vector<size_t> CountOutgoingEdges(const TransportData::Data &data) const;
+  double ComputeRideTime(int distance) const;
 
-  void FillGraphWithBuses(const TransportData::StopsDict &stops,
-                          const TransportData::BusesDict &buses);
+  std::unique_ptr<Router> MakeRouter() const;
+  std::unique_ptr<Router> MakeRouter(std::istream &input) const;
 
+  // Every stop has two vertices: waiting for a bus and departing on it. Stops are numbered
+  // in the order of their names, and their vertices come first in the graph.
   struct StopVertexIds {
     Graph::VertexId wait_on_stop;
     Graph::VertexId depart_from_stop;
   };
-  struct VertexInfo {
-    std::string stop_name;
+  static StopVertexIds GetStopVertexIds(TransportData::StopId stop_id) { return {2 * stop_id, 2 * stop_id + 1}; }
+  TransportData::StopId GetStopId(const std::string &stop_name) const;
+
+  enum class EdgeType : uint8_t {
+    Bus,
+    Wait,
+    // bus chains: boarding starts a bus item, every ride adds one span to it
+    Board,
+    Ride,
+    Alight,
   };
+  struct EdgeInfo {
+    EdgeType type;
+    TransportData::BusId bus_id;  // Bus and Board edges
+    uint32_t span_count;  // Bus edges
+  };
+
+  // Arrays of the compressed graph and the infos of its edges, filled in place: the edges out of
+  // every vertex take a range of known size, and slots of the range are taken in the order of edges
+  struct GraphArrays {
+    explicit GraphArrays(const std::vector<size_t> &out_degrees);
+
+    // first of the count next free slots of the edges out of the vertex
+    size_t TakeSlots(Graph::VertexId from, size_t count);
+    void SetEdge(size_t slot, const Graph::Edge<double> &edge, EdgeInfo edge_info);
+    void AddEdge(const Graph::Edge<double> &edge, EdgeInfo edge_info) {
+      SetEdge(TakeSlots(edge.from, 1), edge, edge_info);
+    }
 
-  struct BusEdgeInfo {
-    std::string bus_name;
-    size_t span_count;
+    std::vector<TransportGraph::CompactId> offsets;
+    std::vector<TransportGraph::CompactId> free_slots;
+    std::vector<TransportGraph::CompactId> sources;
+    std::vector<TransportGraph::CompactId> targets;
+    std::vector<double> weights;
+    std::vector<EdgeInfo> edges_info;
   };
-  struct WaitEdgeInfo {};
-  using EdgeInfo = std::variant<BusEdgeInfo, WaitEdgeInfo>;
+
+  void FillGraphWithStops(GraphArrays &graph) const;
+
+  void FillGraphWithBuses(const TransportData::Data &data, size_t thread_count, GraphArrays &graph) const;
+
+  void FillGraphWithBusChains(const TransportData::Data &data, GraphArrays &graph) const;
 
   RoutingSettings routing_settings_;
   TransportGraph graph_;
   std::unique_ptr<Router> router_;
-  std::unordered_map<std::string, StopVertexIds> stops_vertex_ids_;
-  std::vector<VertexInfo> vertices_info_;
-  std::vector<EdgeInfo> edges_info_;
+  StringTable stop_names_;
+  StringTable bus_names_;
+  FlatArray<EdgeInfo> edges_info_;
 };
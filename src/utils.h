@@ -15,6 +15,9 @@ public:
   Range(It begin, It end) : begin_(begin), end_(end) {}
   It begin() const { return begin_; }
   It end() const { return end_; }
+  size_t size() const { return std::distance(begin_, end_); }
+  bool empty() const { return begin_ == end_; }
+  decltype(auto) operator[](size_t idx) const { return begin_[idx]; }
 
 private:
   It begin_;
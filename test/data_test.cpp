@@ -0,0 +1,91 @@
+#include "catch.hpp"
+#include "json.h"
+#include "transport_data.h"
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+TEST_CASE("DataBuilderNumbersStopsAndBusesByName") {
+  const auto requests = Json::Load(R"([
+      {"type": "Bus", "name": "750", "is_roundtrip": false, "stops": ["Zoo", "Airport"]},
+      {"type": "Stop", "name": "Zoo", "latitude": 55.6, "longitude": 37.2, "road_distances": {"Airport": 1500, "Nowhere": 7}},
+      {"type": "Bus", "name": "256", "is_roundtrip": true, "stops": ["Airport", "Zoo", "Airport"]},
+      {"type": "Stop", "name": "Airport", "latitude": 55.5, "longitude": 37.1, "road_distances": {"Zoo": 1700}}
+  ])").GetRoot().AsArray();
+  const TransportData::Data data = TransportData::ReadData(requests);
+
+  REQUIRE(data.stop_names.size() == 2);
+  REQUIRE(data.stop_names[0] == "Airport");
+  REQUIRE(data.stop_names[1] == "Zoo");
+  REQUIRE(data.bus_names[0] == "256");
+  REQUIRE(data.bus_names[1] == "750");
+
+  REQUIRE(data.buses[0].stops == vector<TransportData::StopId>{0, 1, 0});
+  REQUIRE(data.buses[1].stops == vector<TransportData::StopId>{1, 0, 1});
+  REQUIRE(data.stops[0].bus_ids == vector<TransportData::BusId>{0, 1});
+  REQUIRE(data.road_distances.Get(1, 0) == 1500);
+  REQUIRE(data.road_distances.Get(0, 1) == 1700);
+  REQUIRE(data.buses[0].distances == vector<int>{0, 1700, 3200});
+  REQUIRE(data.buses[1].distances == vector<int>{0, 1500, 3200});
+}
+
+TEST_CASE("DataBuilderReadsParsingEvents") {
+  const string text = R"({"base_requests": [
+      {"type": "Bus", "name": "750", "is_roundtrip": false, "stops": ["Zoo", "Airport"], "extra": [{"stops": ["Moon"]}]},
+      {"type": "Stop", "name": "Zoo", "latitude": 55, "longitude": 37.2, "road_distances": {"Airport": 1500}},
+      {"type": "Stop", "name": "Airport", "latitude": 55.5, "longitude": 37.1, "road_distances": {"Zoo": 1700}}
+  ]})";
+  TransportData::DataBuilder builder;
+  Json::Load(text, {{"base_requests", &builder}});
+  const TransportData::Data data = move(builder).Build();
+  const TransportData::Data expected = TransportData::ReadData(
+      Json::Load(text).GetRoot().AsMap().at("base_requests").AsArray());
+
+  REQUIRE(data.stop_names.size() == 2);
+  REQUIRE(data.stop_names[1] == "Zoo");
+  REQUIRE(data.stops[1].position.latitude == 55);
+  REQUIRE(data.buses[0].stops == vector<TransportData::StopId>{1, 0, 1});
+  REQUIRE(data.buses[0].stops == expected.buses[0].stops);
+  REQUIRE(data.buses[0].distances == expected.buses[0].distances);
+  REQUIRE(data.road_distances.Get(1, 0) == 1500);
+}
+
+TEST_CASE("DataBuilderRejectsIncompleteRequests") {
+  for (const string request : {R"({"type": "Stop", "name": "A", "latitude": 55.6})",
+                               R"({"type": "Bus", "name": "1", "stops": ["A"]})",
+                               R"({"type": "Tram", "name": "1"})"}) {
+    TransportData::DataBuilder builder;
+    REQUIRE_THROWS_AS(Json::Load(R"({"base_requests": [)" + request + "]}", {{"base_requests", &builder}}),
+                      runtime_error);
+  }
+}
+
+TEST_CASE("RoadDistancesServeBothDirections") {
+  const TransportData::RoadDistances distances(4, {{0, 1, 100}, {2, 1, 300}, {1, 2, 200}, {3, 0, 50}});
+  REQUIRE(distances.Get(0, 1) == 100);
+  REQUIRE(distances.Get(1, 0) == 100);
+  REQUIRE(distances.Get(1, 2) == 200);
+  REQUIRE(distances.Get(2, 1) == 300);
+  REQUIRE(distances.Get(0, 3) == 50);
+  REQUIRE_FALSE(distances.Find(0, 2).has_value());
+  REQUIRE_THROWS_AS(distances.Get(2, 3), out_of_range);
+}
+
+TEST_CASE("DataBuilderRejectsUnknownBusStops") {
+  const auto requests = Json::Load(R"([
+      {"type": "Bus", "name": "1", "is_roundtrip": true, "stops": ["Zoo", "Zoo"]}
+  ])").GetRoot().AsArray();
+  REQUIRE_THROWS_AS(TransportData::ReadData(requests), out_of_range);
+}
+
+TEST_CASE("DataBuilderDropsDistancesToUndescribedStops") {
+  const auto requests = Json::Load(R"([
+      {"type": "Stop", "name": "A", "latitude": 55.6, "longitude": 37.2, "road_distances": {"Ghost": 1000}}
+  ])").GetRoot().AsArray();
+  const TransportData::Data data = TransportData::ReadData(requests);
+  REQUIRE(data.stop_names.size() == 1);
+  REQUIRE(data.stop_names[0] == "A");
+  REQUIRE_FALSE(data.road_distances.Find(0, 0).has_value());
+}
@@ -0,0 +1,98 @@
+#include "catch.hpp"
+#include "json.h"
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+TEST_CASE("JsonLoadBuildsTree") {
+  const auto root = Json::Load(R"( {"name": "Tolstopaltsevo", "latitude": 55.611087, "distance": -3900,
+                                    "flags": [true, false], "scale": 1e2, "empty": {}, "nothing": [] } )"s).GetRoot();
+  const Json::Dict &dict = root.AsMap();
+  REQUIRE(dict.at("name").AsString() == "Tolstopaltsevo");
+  REQUIRE(dict.at("latitude").IsDouble());
+  REQUIRE(dict.at("latitude").AsDouble() == 55.611087);
+  REQUIRE(dict.at("distance").IsInt());
+  REQUIRE(dict.at("distance").AsInt() == -3900);
+  REQUIRE(dict.at("flags").AsArray().size() == 2);
+  REQUIRE(dict.at("flags").AsArray()[0].AsBool());
+  REQUIRE(dict.at("scale").AsDouble() == 100);
+  REQUIRE(dict.at("empty").AsMap().empty());
+  REQUIRE(dict.at("nothing").AsArray().empty());
+}
+
+TEST_CASE("JsonLoadDecodesEscapes") {
+  const auto root = Json::Load(R"(["say \"hi\"\n", "\u00e9\u20AC", "\ud83d\ude8c"])"s).GetRoot();
+  const Json::Array &strings = root.AsArray();
+  REQUIRE(strings[0].AsString() == "say \"hi\"\n");
+  REQUIRE(strings[1].AsString() == "\xC3\xA9\xE2\x82\xAC");
+  REQUIRE(strings[2].AsString() == "\xF0\x9F\x9A\x8C");
+}
+
+namespace {
+  // Writes events as tokens separated by spaces
+  class EventRecorder : public Json::Handler {
+  public:
+    void StartArray() override { events += "[ "; }
+    void EndArray() override { events += "] "; }
+    void StartDict() override { events += "{ "; }
+    void EndDict() override { events += "} "; }
+    void Key(string_view key) override { events.append(key).append(": "); }
+    void String(string_view value) override { events.append(value).append(" "); }
+    void Int(int value) override { events += to_string(value) + " "; }
+    void Double(double value) override { events += to_string(value) + " "; }
+    void Bool(bool value) override { events += value ? "true " : "false "; }
+
+    string events;
+  };
+}
+
+TEST_CASE("JsonLoadStreamsRootArrayItems") {
+  EventRecorder recorder;
+  const auto root = Json::Load(
+      R"({"base_requests": [{"name": "A", "stops": ["x", []]}, {"name": "B"}], "stat_requests": [{"name": "C"}],
+          "after": 1})"s,
+      {{"base_requests", &recorder}}
+  ).GetRoot();
+  REQUIRE(recorder.events == "{ name: A stops: [ x [ ] ] } { name: B } ");
+  REQUIRE(root.AsMap().at("base_requests").AsArray().empty());
+  REQUIRE(root.AsMap().at("stat_requests").AsArray().size() == 1);
+  REQUIRE(root.AsMap().at("after").AsInt() == 1);
+}
+
+TEST_CASE("JsonLoadRejectsInvalidInput") {
+  for (const string text : {"", "{", "[1, 2", R"({"a" 1})", R"(["abc)", "nul", "1 2", "99999999999"}) {
+    REQUIRE_THROWS_AS(Json::Load(text), runtime_error);
+  }
+}
+
+TEST_CASE("JsonWriterEscapesAndFormats") {
+  ostringstream output;
+  {
+    Json::Writer writer(output, 6);
+    writer.StartDict();
+    writer.Key("svg");
+    writer.String("<text x=\"1\">a\\b\n</text>");
+    writer.Key("numbers");
+    writer.StartArray();
+    writer.Int(-42);
+    writer.Double(29.26);
+    writer.Double(1.0 / 3);
+    writer.Bool(false);
+    writer.EndArray();
+    writer.EndDict();
+  }
+  REQUIRE(output.str() == R"({"svg": "<text x=\"1\">a\\b\n</text>", "numbers": [-42, 29.26, 0.333333, false]})");
+}
+
+TEST_CASE("JsonWriterOutputLoadsBack") {
+  const auto root = Json::Load(R"({"a": [1, 2.5, {"b": "q\"uote"}], "c": true})"s).GetRoot();
+  ostringstream output;
+  {
+    Json::Writer writer(output);
+    Json::WriteNode(root, writer);
+  }
+  REQUIRE(Json::Load(output.str()).GetRoot() == root);
+}
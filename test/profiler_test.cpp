@@ -0,0 +1,60 @@
+#include "catch.hpp"
+#include "json.h"
+#include "profiler.h"
+#include "test_utils.h"
+#include "transport_data.h"
+#include "transport_database.h"
+#include "transport_informer.h"
+#include <string>
+
+using namespace std;
+
+namespace {
+  Json::Dict GetProfile() {
+    Json::TreeBuilder builder;
+    Profiler::WriteReport(builder);
+    return builder.ExtractRoot().AsMap();
+  }
+}
+
+TEST_CASE("ProfilerReportsPhasesAndRequestLatencies") {
+  const Json::Dict input = ReadExampleInput("example3");
+  const Json::Array &requests = input.at("stat_requests").AsArray();
+  int stop_count = 0;
+  for (const Json::Node &request : input.at("base_requests").AsArray()) {
+    stop_count += request.AsMap().at("type").AsString() == "Stop";
+  }
+  int route_count = 0;
+  for (const Json::Node &request : requests) {
+    route_count += request.AsMap().at("type").AsString() == "Route";
+  }
+
+  Profiler::Reset();
+  {
+    const auto db = MakeExampleDatabase(input);
+    [[maybe_unused]] const auto responses = TransportInformer::Informer().ProcessRequests(db, requests);
+  }
+  REQUIRE(GetProfile().at("phases").AsMap().empty());
+  REQUIRE(GetProfile().at("latencies").AsMap().empty());
+
+  Profiler::Enable();
+  {
+    const auto db = MakeExampleDatabase(input);
+    [[maybe_unused]] const auto responses = TransportInformer::Informer(nullptr, 4).ProcessRequests(db, requests);
+  }
+  Profiler::Disable();
+  const Json::Dict profile = GetProfile();
+  Profiler::Reset();
+
+  const Json::Dict &phases = profile.at("phases").AsMap();
+  for (const string phase : {"database.tables", "router.graph", "router.preprocess"}) {
+    REQUIRE(phases.at(phase).AsMap().at("count").AsInt() == 1);
+    REQUIRE(phases.at(phase).AsMap().at("total_ms").AsDouble() >= 0);
+  }
+  REQUIRE(profile.at("counters").AsMap().at("stops").AsInt() == stop_count);
+
+  const Json::Dict &route_latencies = profile.at("latencies").AsMap().at("Route").AsMap();
+  REQUIRE(route_latencies.at("count").AsInt() == route_count);
+  REQUIRE(route_latencies.at("p50_us").AsDouble() <= route_latencies.at("p99_us").AsDouble());
+  REQUIRE(route_latencies.at("p99_us").AsDouble() <= route_latencies.at("max_us").AsDouble());
+}
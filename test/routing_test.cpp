@@ -1,50 +1,316 @@
 #include "utils.h"
 #include "catch.hpp"
 #include "json.h"
+#include "map_builder.h"
+#include "network_generator.h"
+#include "profiler.h"
 #include "test_utils.h"
 #include "transport_data.h"
 #include "transport_informer.h"
 #include "transport_database.h"
+#include "transport_router.h"
+#include "router.h"
+#include "dijkstra_router.h"
+#include "contraction_hierarchies_router.h"
 #include <algorithm>
-#include <fstream>
-#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
 #include <vector>
 
 using namespace std;
 
-vector<Json::Node> ProcessRoutingExample(const Json::Document &doc) {
-  const map<string, Json::Node> input = doc.GetRoot().AsMap();
-  const vector<Json::Node> &database_input = input.at("base_requests").AsArray();
-  const map<string, Json::Node> &settings = input.at("routing_settings").AsMap();
-  TransportDatabase::Database db(TransportData::ReadData(database_input), settings);
-
+vector<Json::Node> ProcessRoutingExample(const string &example, const string &routing_algorithm = "floyd_warshall",
+                                         const string &graph_model = "stop_pairs") {
+  const Json::Dict input = ReadExampleInput(example);
+  const auto db = MakeExampleDatabase(input, MakeRoutingSettings(input, routing_algorithm, graph_model));
   TransportInformer::Informer informer;
-  const vector<Json::Node> &info_requests = input.at("stat_requests").AsArray();
-  return informer.ProcessRequests(db, info_requests);
+  return informer.ProcessRequests(db, input.at("stat_requests").AsArray());
+}
+
+Json::Dict GetProfileCounters() {
+  Json::TreeBuilder profile;
+  Profiler::WriteReport(profile);
+  return profile.ExtractRoot().AsMap().at("counters").AsMap();
 }
 
 TEST_CASE("RoutingExample1") {
-  ifstream input_stream("routing_queries/example1-input.json");
-  const auto output = ProcessRoutingExample(Json::Load(input_stream));
-  ifstream correct_stream("routing_queries/example1-output.json");
-  const auto correct = Json::Load(correct_stream).GetRoot().AsArray();
-  CheckResponses(output, correct);
+  CheckResponses(ProcessRoutingExample("example1"), ReadExampleOutput("example1"));
 }
 
 TEST_CASE("RoutingExample2") {
-  ifstream input_stream("routing_queries/example2-input.json");
-  const auto output = ProcessRoutingExample(Json::Load(input_stream));
-
-  ifstream correct_stream("routing_queries/example2-output.json");
-  const auto correct = Json::Load(correct_stream).GetRoot().AsArray();
-  CheckResponses(output, correct);
+  CheckResponses(ProcessRoutingExample("example2"), ReadExampleOutput("example2"));
 }
 
 TEST_CASE("RoutingExample3") {
-  ifstream input_stream("routing_queries/example3-input.json");
-  const auto output = ProcessRoutingExample(Json::Load(input_stream));
+  CheckResponses(ProcessRoutingExample("example3"), ReadExampleOutput("example3"));
+}
+
+TEST_CASE("RoutingExamplesAllRoutersAndGraphModels") {
+  for (const string routing_algorithm : {"floyd_warshall", "dijkstra", "contraction_hierarchies"}) {
+    for (const string graph_model : {"stop_pairs", "bus_chains"}) {
+      for (const string example : {"example1", "example2", "example3"}) {
+        CheckResponses(ProcessRoutingExample(example, routing_algorithm, graph_model), ReadExampleOutput(example));
+      }
+    }
+  }
+}
+
+TEST_CASE("RequestsReadFromParsingEventsAnswerLikeNodes") {
+  const Json::Dict input = ReadExampleInput("example3");
+  ostringstream input_text;
+  {
+    Json::Writer writer(input_text);
+    Json::WriteNode(Json::Node(input), writer);
+  }
+  TransportData::DataBuilder data_builder;
+  Requests::StatRequestsBuilder stat_requests_builder;
+  Json::Load(input_text.str(), {{"base_requests", &data_builder}, {"stat_requests", &stat_requests_builder}});
+  const TransportDatabase::Database db(move(data_builder).Build(), input.at("routing_settings").AsMap());
+  const vector<Requests::StatRequest> stat_requests = move(stat_requests_builder).Build();
+
+  const TransportInformer::Informer informer;
+  ostringstream output;
+  {
+    Json::Writer writer(output);
+    informer.ProcessRequests(db, stat_requests, writer);
+  }
+  CheckResponses(Json::Load(output.str()).GetRoot().AsArray(),
+                 informer.ProcessRequests(MakeExampleDatabase(input), input.at("stat_requests").AsArray()));
+}
+
+TEST_CASE("RoutersAgreeOnRandomGraph") {
+  const size_t vertex_count = 100;
+  mt19937 generator(42);
+  uniform_int_distribution<size_t> vertex_distribution(0, vertex_count - 1);
+  uniform_int_distribution<int> weight_distribution(0, 20);
+
+  Graph::DirectedWeightedGraph<double> graph_builder(vertex_count);
+  for (size_t i = 0; i < vertex_count * 3; ++i) {
+    graph_builder.AddEdge({vertex_distribution(generator), vertex_distribution(generator),
+                           static_cast<double>(weight_distribution(generator))});
+  }
+  const Graph::CompressedDirectedWeightedGraph<double> graph(graph_builder);
+
+  Graph::FloydWarshallRouter<double> floyd_warshall_router(graph);
+  Graph::DijkstraRouter<double> dijkstra_router(graph);
+  Graph::ContractionHierarchiesRouter<double> ch_router(graph);
+  Graph::Router<double>::ExpandedRoute expected_edges;
+  Graph::Router<double>::ExpandedRoute edges;
+  for (size_t i = 0; i < 1000; ++i) {
+    const Graph::VertexId from = vertex_distribution(generator);
+    const Graph::VertexId to = vertex_distribution(generator);
+    const auto expected = floyd_warshall_router.BuildRoute(from, to, expected_edges);
+    for (Graph::Router<double> *router : {static_cast<Graph::Router<double> *>(&dijkstra_router),
+                                          static_cast<Graph::Router<double> *>(&ch_router)}) {
+      const auto route_weight = router->BuildRoute(from, to, edges);
+      REQUIRE(route_weight.has_value() == expected.has_value());
+      if (!route_weight) {
+        REQUIRE(edges.empty());
+        continue;
+      }
+      REQUIRE(*route_weight == *expected);
+      double weight = 0;
+      Graph::VertexId vertex = from;
+      for (const Graph::EdgeId edge_id : edges) {
+        const auto edge = graph.GetEdge(edge_id);
+        REQUIRE(edge.from == vertex);
+        vertex = edge.to;
+        weight += edge.weight;
+      }
+      REQUIRE(vertex == to);
+      REQUIRE(weight == *route_weight);
+    }
+  }
+}
+
+TEST_CASE("ContractionHierarchiesAgreeWithDijkstraOnGeneratedNetwork") {
+  NetworkGenerator::Params params;
+  params.stop_count = 400;
+  params.bus_count = 20;
+  params.request_count = 0;
+  const Json::Dict input = NetworkGenerator::GenerateInput(params);
+  const TransportData::Data data = ReadExampleData(input);
+
+  for (const string graph_model : {"stop_pairs", "bus_chains"}) {
+    const TransportRouter ch_router(data, MakeRoutingSettings(input, "contraction_hierarchies", graph_model));
+    const TransportRouter dijkstra_router(data, MakeRoutingSettings(input, "dijkstra", graph_model));
+
+    mt19937 generator(42);
+    uniform_int_distribution<size_t> stop_distribution(0, data.stop_names.size() - 1);
+    for (size_t i = 0; i < 300; ++i) {
+      const string stop_from(data.stop_names[stop_distribution(generator)]);
+      const string stop_to(data.stop_names[stop_distribution(generator)]);
+      const auto expected = dijkstra_router.FindRoute(stop_from, stop_to);
+      const auto route = ch_router.FindRoute(stop_from, stop_to);
+      REQUIRE(route.has_value() == expected.has_value());
+      if (route) {
+        REQUIRE(route->total_time == Approx(expected->total_time));
+      }
+    }
+  }
+}
+
+TEST_CASE("ParallelRequestsKeepOrder") {
+  const Json::Dict input = ReadExampleInput("example3");
+  const auto db = MakeExampleDatabase(input, MakeRoutingSettings(input, "contraction_hierarchies"));
+  const auto map_builder = make_shared<Visualisation::MapBuilder>(db, MakeRenderSettings(input));
 
-  ifstream correct_stream("routing_queries/example3-output.json");
-  const auto correct = Json::Load(correct_stream).GetRoot().AsArray();
-  CheckResponses(output, correct);
-}
\ No newline at end of file
+  // enough requests for many chunks, with unique ids; Map requests come at the borders of chunks too
+  vector<Json::Node> requests;
+  for (int copy = 0; copy < 100; ++copy) {
+    for (const Json::Node &request : input.at("stat_requests").AsArray()) {
+      Json::Dict request_dict = request.AsMap();
+      if (requests.size() % 64 == 0 || requests.size() % 64 == 63 || requests.size() % 9 == 0) {
+        request_dict = Json::Dict{{"type", Json::Node("Map"s)}};
+      }
+      request_dict["id"] = Json::Node(static_cast<int>(requests.size()));
+      requests.emplace_back(move(request_dict));
+    }
+  }
+
+  const TransportInformer::Informer sequential_informer(map_builder);
+  const TransportInformer::Informer parallel_informer(map_builder, 4);
+  const auto expected = sequential_informer.ProcessRequests(db, requests);
+  const auto responses = parallel_informer.ProcessRequests(db, requests);
+  REQUIRE(responses.size() == expected.size());
+  for (size_t idx = 0; idx < responses.size(); ++idx) {
+    REQUIRE(responses[idx].AsMap().at("request_id").AsInt() == static_cast<int>(idx));
+  }
+  CheckResponses(responses, expected);
+
+  ostringstream sequential_output;
+  ostringstream parallel_output;
+  {
+    Json::Writer sequential_writer(sequential_output, 6);
+    sequential_informer.ProcessRequests(db, requests, sequential_writer);
+    Json::Writer parallel_writer(parallel_output, 6);
+    parallel_informer.ProcessRequests(db, requests, parallel_writer);
+  }
+  REQUIRE(parallel_output.str() == sequential_output.str());
+}
+
+TEST_CASE("ParallelGraphBuildFindsSameRoutes") {
+  const Json::Dict input = ReadExampleInput("example3");
+  const TransportData::Data data = ReadExampleData(input);
+  const Json::Dict &settings = input.at("routing_settings").AsMap();
+  const TransportRouter sequential_router(data, settings);
+  const TransportRouter parallel_router(data, settings, 4);
+
+  for (size_t from = 0; from < data.stop_names.size(); ++from) {
+    for (size_t to = 0; to < data.stop_names.size(); ++to) {
+      const string stop_from(data.stop_names[from]);
+      const string stop_to(data.stop_names[to]);
+      const auto expected = sequential_router.FindRoute(stop_from, stop_to);
+      const auto route = parallel_router.FindRoute(stop_from, stop_to);
+      REQUIRE(route.has_value() == expected.has_value());
+      if (route) {
+        REQUIRE(route->total_time == expected->total_time);
+        REQUIRE(route->items.size() == expected->items.size());
+      }
+    }
+  }
+}
+
+TEST_CASE("ParallelDatabaseBuildAnswersLikeSequential") {
+  for (const string example : {"example1", "example2", "example3"}) {
+    const Json::Dict input = ReadExampleInput(example);
+    const auto sequential_db = MakeExampleDatabase(input);
+    const auto parallel_db = MakeExampleDatabase(input, 4);
+
+    const TransportInformer::Informer informer;
+    const vector<Json::Node> &info_requests = input.at("stat_requests").AsArray();
+    CheckResponses(informer.ProcessRequests(parallel_db, info_requests),
+                   informer.ProcessRequests(sequential_db, info_requests));
+  }
+}
+
+TEST_CASE("DatabaseRejectsBadRoutingSettings") {
+  const Json::Dict input = ReadExampleInput("example1");
+  const Json::Dict settings = MakeRoutingSettings(input, "bellman_ford");
+  for (const size_t thread_count : {1, 4}) {
+    REQUIRE_THROWS_AS(MakeExampleDatabase(input, settings, thread_count), runtime_error);
+  }
+}
+
+TEST_CASE("RepeatedRoutesAreCached") {
+  const Json::Dict input = ReadExampleInput("example3");
+  const TransportData::Data data = ReadExampleData(input);
+  const auto db = MakeExampleDatabase(input);
+  const TransportRouter router(data, input.at("routing_settings").AsMap());
+
+  Profiler::Reset();
+  Profiler::Enable();
+  int found_count = 0;
+  for (int round = 0; round < 2; ++round) {
+    for (size_t from = 0; from < data.stop_names.size(); ++from) {
+      for (size_t to = 0; to < data.stop_names.size(); ++to) {
+        const string stop_from(data.stop_names[from]);
+        const string stop_to(data.stop_names[to]);
+        const auto route = db.FindRoute(stop_from, stop_to);
+        const auto expected = router.FindRoute(stop_from, stop_to);
+        REQUIRE(static_cast<bool>(route) == expected.has_value());
+        if (route) {
+          REQUIRE(route->total_time == expected->total_time);
+          REQUIRE(route->items.size() == expected->items.size());
+          REQUIRE(route == db.FindRoute(stop_from, stop_to));
+          found_count += round == 0;
+        }
+      }
+    }
+  }
+  Profiler::Disable();
+  const Json::Dict counters = GetProfileCounters();
+  Profiler::Reset();
+
+  // the first round misses every pair once; each found route is asked for again in both rounds
+  const auto pair_count = static_cast<int>(data.stop_names.size() * data.stop_names.size());
+  REQUIRE(found_count > 0);
+  REQUIRE(counters.at("route_cache_misses").AsInt() == pair_count);
+  REQUIRE(counters.at("route_cache_hits").AsInt() == pair_count + 2 * found_count);
+  REQUIRE_THROWS_AS(db.FindRoute("Nowhere", string(data.stop_names[0])), out_of_range);
+}
+
+TEST_CASE("RouteCacheEvictsLeastRecentlyUsedRoutes") {
+  NetworkGenerator::Params params;
+  params.stop_count = 70;
+  params.bus_count = 5;
+  params.min_route_length = 2;
+  params.max_route_length = 5;
+  params.request_count = 0;
+  const Json::Dict input = NetworkGenerator::GenerateInput(params);
+  const TransportData::Data data = ReadExampleData(input);
+  const auto db = MakeExampleDatabase(input);
+
+  const size_t stop_count = data.stop_names.size();
+  const string first_from(data.stop_names[0]);
+  const string first_to(data.stop_names[1]);
+  const auto count_misses = [] { return GetProfileCounters().at("route_cache_misses").AsInt(); };
+  Profiler::Reset();
+  Profiler::Enable();
+  [[maybe_unused]] auto route = db.FindRoute(first_from, first_to);
+  int other_pairs = 0;
+  for (size_t from = 0; from < stop_count; ++from) {
+    for (size_t to = 0; to < stop_count; ++to) {
+      if (from != 0 || to != 1) {
+        route = db.FindRoute(string(data.stop_names[from]), string(data.stop_names[to]));
+        ++other_pairs;
+      }
+    }
+  }
+  REQUIRE(other_pairs > static_cast<int>(TransportDatabase::Database::ROUTE_CACHE_SIZE));
+  const int misses = count_misses();
+  REQUIRE(misses == other_pairs + 1);
+
+  // the last pair is still cached, the first one has been pushed out by the others
+  const string last_stop(data.stop_names[stop_count - 1]);
+  route = db.FindRoute(last_stop, last_stop);
+  REQUIRE(count_misses() == misses);
+  route = db.FindRoute(first_from, first_to);
+  REQUIRE(count_misses() == misses + 1);
+  route = db.FindRoute(first_from, first_to);
+  REQUIRE(count_misses() == misses + 1);
+  Profiler::Disable();
+  Profiler::Reset();
+}
@@ -0,0 +1,88 @@
+#include "catch.hpp"
+#include "json.h"
+#include "map_builder.h"
+#include "serialization.h"
+#include "test_utils.h"
+#include "transport_data.h"
+#include "transport_database.h"
+#include "transport_informer.h"
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+TEST_CASE("DatabaseSnapshotAnswersLikeOriginal") {
+  for (const string routing_algorithm : {"floyd_warshall", "dijkstra", "contraction_hierarchies"}) {
+    for (const string example : {"example1", "example2", "example3"}) {
+      const Json::Dict input = ReadExampleInput(example);
+      const auto db = MakeExampleDatabase(input, MakeRoutingSettings(input, routing_algorithm));
+
+      stringstream snapshot;
+      Serialization::WriteHeader(snapshot);
+      db.Serialize(snapshot);
+      Serialization::CheckHeader(snapshot);
+      const auto restored_db = TransportDatabase::Database::Deserialize(snapshot);
+
+      TransportInformer::Informer informer;
+      const vector<Json::Node> &info_requests = input.at("stat_requests").AsArray();
+      CheckResponses(informer.ProcessRequests(restored_db, info_requests),
+                     informer.ProcessRequests(db, info_requests));
+    }
+  }
+}
+
+TEST_CASE("MappedDatabaseSnapshotAnswersLikeOriginal") {
+  for (const string routing_algorithm : {"floyd_warshall", "dijkstra", "contraction_hierarchies"}) {
+    const Json::Dict input = ReadExampleInput("example3");
+    const auto db = MakeExampleDatabase(input, MakeRoutingSettings(input, routing_algorithm));
+
+    const string snapshot_file = "mapped_snapshot_" + routing_algorithm + ".db";
+    {
+      ofstream output(snapshot_file, ios::binary);
+      Serialization::WriteHeader(output);
+      db.Serialize(output);
+    }
+    Serialization::MemoryBuffer buffer(make_shared<const Serialization::MappedFile>(snapshot_file));
+    istream snapshot(&buffer);
+    Serialization::CheckHeader(snapshot);
+    const auto restored_db = TransportDatabase::Database::Deserialize(snapshot);
+
+    TransportInformer::Informer informer;
+    const vector<Json::Node> &info_requests = input.at("stat_requests").AsArray();
+    CheckResponses(informer.ProcessRequests(restored_db, info_requests),
+                   informer.ProcessRequests(db, info_requests));
+
+    REQUIRE(restored_db.GetStopCount() == db.GetStopCount());
+    REQUIRE(restored_db.GetBusCount() == db.GetBusCount());
+    for (TransportData::BusId bus_id = 0; bus_id < db.GetBusCount(); ++bus_id) {
+      REQUIRE(restored_db.GetBusName(bus_id) == db.GetBusName(bus_id));
+      const auto stops = db.GetBusStopIds(bus_id);
+      const auto restored_stops = restored_db.GetBusStopIds(bus_id);
+      REQUIRE(vector<TransportData::StopId>(restored_stops.begin(), restored_stops.end())
+              == vector<TransportData::StopId>(stops.begin(), stops.end()));
+    }
+    remove(snapshot_file.c_str());
+  }
+}
+
+TEST_CASE("MapSnapshotRendersLikeOriginal") {
+  const Json::Dict input = ReadExampleInput("example2");
+  const auto db = MakeExampleDatabase(input);
+  const Visualisation::MapBuilder map_builder(db, MakeRenderSettings(input));
+
+  stringstream snapshot;
+  map_builder.Serialize(snapshot);
+  const Visualisation::MapBuilder restored_map_builder(db, snapshot);
+  REQUIRE(restored_map_builder.GetMap() == map_builder.GetMap());
+  // the map is rendered once and shared
+  REQUIRE(&map_builder.GetMap() == &map_builder.GetMap());
+}
+
+TEST_CASE("SnapshotHeaderIsChecked") {
+  stringstream snapshot("not a snapshot");
+  REQUIRE_THROWS_AS(Serialization::CheckHeader(snapshot), runtime_error);
+}
@@ -0,0 +1,48 @@
+#include "catch.hpp"
+#include "json.h"
+#include "server.h"
+#include "test_utils.h"
+#include "transport_data.h"
+#include "transport_database.h"
+#include "transport_informer.h"
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+TEST_CASE("ServerAnswersRequestLines") {
+  const Json::Dict input = ReadExampleInput("example3");
+  const auto db = MakeExampleDatabase(input);
+  const TransportInformer::Informer informer;
+  const Json::Array &requests = input.at("stat_requests").AsArray();
+
+  ostringstream request_lines;
+  for (const Json::Node &request : requests) {
+    Json::Writer writer(request_lines);
+    Json::WriteNode(request, writer);
+    writer.Flush();
+    request_lines << "\n\n";
+  }
+  request_lines << R"({"id": 100500, "type": "Unknown"})" << '\n' << "[1, 2" << '\n';
+
+  istringstream server_input(request_lines.str());
+  ostringstream server_output;
+  Server::Serve(db, informer, server_input, server_output);
+
+  vector<Json::Node> responses;
+  istringstream response_lines(server_output.str());
+  for (string line; getline(response_lines, line);) {
+    responses.push_back(Json::Load(line).GetRoot());
+  }
+  REQUIRE(responses.size() == requests.size() + 2);
+
+  const Json::Dict unknown_request_response = responses[requests.size()].AsMap();
+  REQUIRE(unknown_request_response.at("request_id").AsInt() == 100500);
+  REQUIRE(unknown_request_response.count("error_message") == 1);
+  REQUIRE(responses.back().AsMap().count("request_id") == 0);
+  REQUIRE(responses.back().AsMap().count("error_message") == 1);
+
+  responses.resize(requests.size());
+  CheckResponses(responses, informer.ProcessRequests(db, requests));
+}
@@ -7,9 +7,42 @@
 #include <fstream>
 #include <map>
 #include <string>
+#include <vector>
 
 using namespace std;
 
+// Several routes may share the optimal total time, and the route contract accepts any of them,
+// so bus items are compared without the bus name
+static bool AreEquivalentRouteItems(const Json::Node &lhs, const Json::Node &rhs) {
+  if (lhs.AsMap().at("type").AsString() != "Bus" || rhs.AsMap().at("type").AsString() != "Bus") {
+    return lhs == rhs;
+  }
+  Json::Dict lhs_item = lhs.AsMap();
+  Json::Dict rhs_item = rhs.AsMap();
+  lhs_item.erase("bus");
+  rhs_item.erase("bus");
+  return Json::Node(move(lhs_item)) == Json::Node(move(rhs_item));
+}
+
+static bool AreEquivalentResponses(const Json::Node &lhs, const Json::Node &rhs) {
+  const Json::Dict &lhs_dict = lhs.AsMap();
+  const Json::Dict &rhs_dict = rhs.AsMap();
+  if (lhs_dict.count("items") == 0 || rhs_dict.count("items") == 0) {
+    return lhs == rhs;
+  }
+  const Json::Array &lhs_items = lhs_dict.at("items").AsArray();
+  const Json::Array &rhs_items = rhs_dict.at("items").AsArray();
+  if (!(lhs_dict.at("total_time") == rhs_dict.at("total_time")) || lhs_items.size() != rhs_items.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < lhs_items.size(); ++i) {
+    if (!AreEquivalentRouteItems(lhs_items[i], rhs_items[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
 void CheckResponses(const vector<Json::Node> &lhs, const vector<Json::Node> &rhs) {
   REQUIRE(lhs.size() == rhs.size());
   for (const Json::Node &lhs_response : lhs) {
@@ -17,6 +50,46 @@ void CheckResponses(const vector<Json::Node> &lhs, const vector<Json::Node> &rhs
       return lhs_response.AsMap().at("request_id").AsInt() == item.AsMap().at("request_id").AsInt();
     });
     REQUIRE(rhs_response_it != rhs.end());
-    REQUIRE(lhs_response == *rhs_response_it);
+    REQUIRE(AreEquivalentResponses(lhs_response, *rhs_response_it));
   }
-}
\ No newline at end of file
+}
+
+Json::Dict ReadExampleInput(const string &example) {
+  ifstream input_stream("routing_queries/" + example + "-input.json");
+  return Json::Load(input_stream).GetRoot().AsMap();
+}
+
+vector<Json::Node> ReadExampleOutput(const string &example) {
+  ifstream output_stream("routing_queries/" + example + "-output.json");
+  return Json::Load(output_stream).GetRoot().AsArray();
+}
+
+TransportData::Data ReadExampleData(const Json::Dict &input) {
+  return TransportData::ReadData(input.at("base_requests").AsArray());
+}
+
+Json::Dict MakeRoutingSettings(const Json::Dict &input, const string &routing_algorithm, const string &graph_model) {
+  Json::Dict settings = input.at("routing_settings").AsMap();
+  settings["routing_algorithm"] = Json::Node(routing_algorithm);
+  settings["graph_model"] = Json::Node(graph_model);
+  return settings;
+}
+
+TransportDatabase::Database MakeExampleDatabase(const Json::Dict &input, size_t thread_count) {
+  return MakeExampleDatabase(input, input.at("routing_settings").AsMap(), thread_count);
+}
+
+TransportDatabase::Database MakeExampleDatabase(const Json::Dict &input, const Json::Dict &routing_settings,
+                                                size_t thread_count) {
+  return TransportDatabase::Database(ReadExampleData(input), routing_settings, thread_count);
+}
+
+Json::Dict MakeRenderSettings(const Json::Dict &input) {
+  Json::Dict render_settings = input.at("render_settings").AsMap();
+  render_settings["layers"] = Json::Node(vector<Json::Node>{
+      Json::Node(string("bus_lines")), Json::Node(string("bus_labels")),
+      Json::Node(string("stop_points")), Json::Node(string("stop_labels"))});
+  render_settings["bus_label_font_size"] = Json::Node(18);
+  render_settings["bus_label_offset"] = Json::Node(vector<Json::Node>{Json::Node(7), Json::Node(15)});
+  return render_settings;
+}
@@ -1,7 +1,25 @@
 #pragma once
 
 #include "json.h"
+#include "transport_data.h"
+#include "transport_database.h"
+#include <string>
 #include <vector>
 
 
 void CheckResponses(const std::vector<Json::Node> &lhs, const std::vector<Json::Node> &rhs);
+
+// Input and expected responses of routing_queries/<example>
+Json::Dict ReadExampleInput(const std::string &example);
+std::vector<Json::Node> ReadExampleOutput(const std::string &example);
+
+TransportData::Data ReadExampleData(const Json::Dict &input);
+// Routing settings of the input with another algorithm and graph model
+Json::Dict MakeRoutingSettings(const Json::Dict &input, const std::string &routing_algorithm,
+                               const std::string &graph_model = "stop_pairs");
+// Database of the input built with its own routing settings or the given ones
+TransportDatabase::Database MakeExampleDatabase(const Json::Dict &input, size_t thread_count = 1);
+TransportDatabase::Database MakeExampleDatabase(const Json::Dict &input, const Json::Dict &routing_settings,
+                                                size_t thread_count = 1);
+// Render settings of the input with all the layers
+Json::Dict MakeRenderSettings(const Json::Dict &input);
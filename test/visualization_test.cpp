@@ -1,8 +1,15 @@
 #include "catch.hpp"
+#include "json.h"
+#include "map_builder.h"
 #include "svg.h"
+#include "test_utils.h"
+#include "transport_data.h"
+#include "transport_database.h"
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <stdexcept>
+#include <variant>
 
 using namespace std;
 using namespace Svg;
@@ -55,4 +62,127 @@ TEST_CASE("SVG Library Test") {
   correct_stream << correct_file.rdbuf();
   string correct_output{correct_stream.str()};
   REQUIRE(output == correct_output);
-}
\ No newline at end of file
+}
+
+TEST_CASE("SVG Writer Matches Document") {
+  Svg::Document doc{};
+  doc.Add(Svg::Polyline{}
+              .SetStrokeColor(Svg::Rgba{140, 198, 63, 0.85})
+              .SetStrokeWidth(14.5)
+              .SetStrokeLineCap("round")
+              .SetStrokeLineJoin("round")
+              .AddPoint({50.123456789, -0.000012})
+              .AddPoint({1234567.5, 250}));
+  doc.Add(Svg::Circle{}.SetFillColor("white").SetRadius(6).SetCenter({1e-7, 3.0}));
+  doc.Add(Svg::Text{}
+              .SetPoint({50, 50})
+              .SetOffset({7, -3.25})
+              .SetFontSize(20)
+              .SetFontFamily("Verdana")
+              .SetFontWeight("bold")
+              .SetFillColor("black")
+              .SetData("C++"));
+  stringstream doc_stream;
+  doc.Render(doc_stream);
+
+  Svg::Writer writer;
+  writer.BeginPolyline();
+  writer.AddPoint({50.123456789, -0.000012});
+  writer.AddPoint({1234567.5, 250});
+  writer.EndPolyline({
+      .stroke_color = Svg::Color(Svg::Rgba{140, 198, 63, 0.85}).color_string,
+      .stroke_width = 14.5,
+      .line_cap = "round",
+      .line_join = "round",
+  });
+  writer.Circle({1e-7, 3.0}, 6, {.fill_color = "white"});
+  writer.Text({50, 50}, {7, -3.25}, {.size = 20, .family = "Verdana", .weight = "bold"},
+              {.fill_color = "black"}, "C++");
+
+  REQUIRE(move(writer).Finish() == doc_stream.str());
+}
+
+size_t CountOccurrences(const string &text, const string &pattern) {
+  size_t count = 0;
+  for (size_t pos = text.find(pattern); pos != string::npos; pos = text.find(pattern, pos + 1))
+    ++count;
+  return count;
+}
+
+TEST_CASE("MapTilesRenderOnlyTheirElements") {
+  const Json::Dict input = ReadExampleInput("example3");
+  const auto db = MakeExampleDatabase(input);
+  const Json::Dict render_settings = MakeRenderSettings(input);
+  const Visualisation::MapBuilder map_builder(db, render_settings);
+  const Visualisation::RenderSettings settings = Visualisation::ParseRenderSettings(render_settings);
+
+  // the only tile of zoom 0 is the whole map
+  const auto whole_tile = map_builder.GetTile({0, 0, 0});
+  REQUIRE(whole_tile);
+  string map = map_builder.GetMap();
+  const string header = R"(version="1.1">)";
+  map.replace(map.find(header), header.size(),
+              R"(version="1.1" viewBox="0 0 )" + to_string(static_cast<int>(settings.width)) + " "
+                  + to_string(static_cast<int>(settings.height)) + R"(">)");
+  REQUIRE(*whole_tile == map);
+  REQUIRE(map_builder.GetTile({0, 0, 0}) == whole_tile);
+
+  size_t tile_circles = 0;
+  bool some_stops_culled = false;
+  for (uint32_t x = 0; x < 4; ++x) {
+    for (uint32_t y = 0; y < 4; ++y) {
+      const auto tile = map_builder.GetTile({2, x, y});
+      REQUIRE(tile);
+      tile_circles += CountOccurrences(*tile, "<circle");
+      some_stops_culled = some_stops_culled || CountOccurrences(*tile, "<circle") < db.GetStopCount();
+    }
+  }
+  // stops on the borders of tiles are drawn in each of them
+  REQUIRE(tile_circles >= db.GetStopCount());
+  REQUIRE(some_stops_culled);
+
+  REQUIRE_FALSE(map_builder.GetTile({2, 4, 0}));
+  REQUIRE_FALSE(map_builder.GetTile({40, 0, 0}));
+}
+
+TEST_CASE("RouteMapDrawsOnlyTheRoute") {
+  const Json::Dict input = ReadExampleInput("example3");
+  const auto db = MakeExampleDatabase(input);
+  const Visualisation::MapBuilder map_builder(db, MakeRenderSettings(input));
+
+  // bus 289 from Zagorye to Lipetskaya ulitsa 46, then on from there to Moskvorechye
+  const auto route = db.FindRoute("Zagorye", "Moskvorechye");
+  REQUIRE(route);
+  const string overlay = map_builder.RenderRoute(*route, "Moskvorechye");
+  REQUIRE(CountOccurrences(overlay, "<rect") == 1);
+  REQUIRE(CountOccurrences(overlay, "<polyline") == 2);
+  REQUIRE(CountOccurrences(overlay, "<circle") == 4);
+  for (const string stop : {"Zagorye", "Lipetskaya ulitsa 46", "Moskvorechye"}) {
+    REQUIRE(CountOccurrences(overlay, ">" + stop + "<") == 2);
+  }
+  REQUIRE(CountOccurrences(overlay, ">Lipetskaya ulitsa 40<") == 0);
+  // Zagorye is the only terminal of the bus on the route
+  REQUIRE(CountOccurrences(overlay, ">289<") == 2);
+}
+
+TEST_CASE("RouteMapRejectsRoutesNotInDatabase") {
+  const Json::Dict input = ReadExampleInput("example3");
+  const auto db = MakeExampleDatabase(input);
+  const Visualisation::MapBuilder map_builder(db, MakeRenderSettings(input));
+  const auto route = db.FindRoute("Zagorye", "Moskvorechye");
+  REQUIRE(route);
+
+  auto wrong_span_route = *route;
+  get<Responses::Route::BusItem>(wrong_span_route.items[1]).span_count += 1;
+  REQUIRE_THROWS_AS(map_builder.RenderRoute(wrong_span_route, "Moskvorechye"), logic_error);
+
+  auto unknown_bus_route = *route;
+  get<Responses::Route::BusItem>(unknown_bus_route.items[1]).bus_name = "Nowhere";
+  REQUIRE_THROWS_AS(map_builder.RenderRoute(unknown_bus_route, "Moskvorechye"), logic_error);
+
+  auto no_wait_route = *route;
+  no_wait_route.items.erase(no_wait_route.items.begin());
+  REQUIRE_THROWS_AS(map_builder.RenderRoute(no_wait_route, "Moskvorechye"), logic_error);
+
+  REQUIRE_THROWS_AS(map_builder.RenderRoute(*route, "Nowhere"), logic_error);
+}